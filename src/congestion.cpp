@@ -0,0 +1,295 @@
+#include "congestion.hpp"
+#include <cmath>
+
+namespace jrReliableUDP {
+    std::unique_ptr<CongestionControl> CongestionControl::create(CongestionAlgorithm algo) {
+        switch(algo) {
+        case CUBIC:
+            return std::unique_ptr<CongestionControl>(new Cubic());
+        case BBR:
+            return std::unique_ptr<CongestionControl>(new Bbr());
+        default:
+            return std::unique_ptr<CongestionControl>(new Reno());
+        }
+    }
+
+    void CongestionControl::on_rtt(int64_t rtt_us, int64_t now_us) {
+        (void)now_us;
+        srtt_us = (srtt_us == 0) ? rtt_us : srtt_us + (rtt_us - srtt_us) / 8;
+        if((min_rtt_us == 0) || (rtt_us < min_rtt_us)) {
+            min_rtt_us = std::max<int64_t>(rtt_us, 1);
+        }
+    }
+
+    double CongestionControl::pacing_rate() const {
+        return (srtt_us > 0) ? cwnd() * 1e6 / srtt_us : 0;
+    }
+
+    Reno::Reno() : CONG_WND(INIT_CWND), ssthresh(UINT32_MAX), acked_cnt(0) {
+
+    }
+
+    void Reno::on_ack(const AckSample& s) {
+        // No growth during recovery, nor while the window was not the limit
+        if(s.in_recovery || !s.is_cwnd_limited) {
+            return ;
+        }
+        uint32_t acked = s.acked;
+        if(CONG_WND < ssthresh) {
+            // Slow start, congestion window size index inc
+            uint32_t n = std::min(acked, ssthresh - CONG_WND);
+            CONG_WND += n;
+            acked -= n;
+        }
+        // Congestion avoidance, congestion window size linear inc; whatever slow start left over counts here
+        acked_cnt += acked;
+        if(acked_cnt >= CONG_WND) {
+            acked_cnt -= CONG_WND;
+            ++CONG_WND;
+        }
+    }
+
+    void Reno::on_loss(uint32_t flight, int64_t now_us) {
+        (void)now_us;
+        // Fast retransmition's congestion occurs, halve what was in flight rather than the window
+        ssthresh = std::max<uint32_t>(flight / 2, 2);
+        CONG_WND = ssthresh;
+        acked_cnt = 0;
+    }
+
+    void Reno::on_timeout(uint32_t flight) {
+        // Timeout retransmition's congestion occurs
+        ssthresh = std::max<uint32_t>(flight / 2, 2);
+        CONG_WND = 1;
+        acked_cnt = 0;
+    }
+
+    double Reno::pacing_rate() const {
+        // Like Linux: twice the window per RTT in slow start, 1.2 times after
+        return (srtt_us > 0) ? ((CONG_WND < ssthresh) ? 2.0 : 1.2) * CONG_WND * 1e6 / srtt_us : 0;
+    }
+
+    Cubic::Cubic() : CONG_WND(INIT_CWND), ssthresh(1e9), W_max(0), W_est(0), K(0), origin(0), epoch_us(0) {
+
+    }
+
+    void Cubic::on_ack(const AckSample& s) {
+        if(s.in_recovery || !s.is_cwnd_limited) {
+            return ;
+        }
+        if(CONG_WND < ssthresh) {
+            CONG_WND += s.acked;
+            return ;
+        }
+        if(epoch_us == 0) {
+            // First ACK of the epoch: the curve starts from here and returns to W_max after K seconds
+            epoch_us = s.now_us;
+            W_est = CONG_WND;
+            if(CONG_WND < W_max) {
+                K = std::cbrt((W_max - CONG_WND) / C);
+                origin = W_max;
+            } else {
+                K = 0;
+                origin = CONG_WND;
+            }
+        }
+        // W_cubic(t + RTT), the window one round trip ahead
+        double t = (s.now_us - epoch_us + min_rtt_us) / 1e6;
+        double target = origin + C * std::pow(t - K, 3);
+        W_est += 3 * (1 - BETA) / (1 + BETA) * s.acked / CONG_WND;
+        if(target < W_est) {
+            // Reno-friendly region
+            CONG_WND = std::max(CONG_WND, W_est);
+        } else {
+            // Never more than 1.5x per round trip
+            target = std::min(std::max(target, CONG_WND), 1.5 * CONG_WND);
+            CONG_WND += (target - CONG_WND) / CONG_WND * s.acked;
+        }
+    }
+
+    void Cubic::on_loss(uint32_t flight, int64_t now_us) {
+        (void)flight;
+        (void)now_us;
+        epoch_us = 0;
+        // Fast convergence: a flow losing ground releases bandwidth for newer ones
+        W_max = (CONG_WND < W_max) ? CONG_WND * (1 + BETA) / 2 : CONG_WND;
+        ssthresh = std::max(CONG_WND * BETA, 2.0);
+        CONG_WND = ssthresh;
+    }
+
+    void Cubic::on_timeout(uint32_t flight) {
+        (void)flight;
+        epoch_us = 0;
+        W_max = CONG_WND;
+        ssthresh = std::max(CONG_WND * BETA, 2.0);
+        CONG_WND = 1;
+    }
+
+    double Cubic::pacing_rate() const {
+        return (srtt_us > 0) ? ((CONG_WND < ssthresh) ? 2.0 : 1.2) * CONG_WND * 1e6 / srtt_us : 0;
+    }
+
+    static const double CYCLE_GAINS[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};   // PROBE_BW: probe up, drain, cruise
+
+    Bbr::Bbr()
+        : mode(STARTUP), round(0), next_round_delivered(0), full_bw(0), full_bw_cnt(0), cycle_idx(0), cycle_us(0),
+          min_rtt_stamp_us(0), probe_rtt_done_us(0), pacing_gain(HIGH_GAIN), cwnd_gain(HIGH_GAIN),
+          CONG_WND(INIT_CWND), prior_cwnd(INIT_CWND), in_recovery(false) {
+        std::fill(bw, bw + BW_ROUNDS, 0.0);
+    }
+
+    double Bbr::btl_bw() const {
+        return *std::max_element(bw, bw + BW_ROUNDS);
+    }
+
+    uint32_t Bbr::bdp(double gain) const {
+        if((min_rtt_us == 0) || (btl_bw() == 0)) {
+            return INIT_CWND;
+        }
+        return std::max(static_cast<uint32_t>(std::ceil(gain * btl_bw() * min_rtt_us / 1e6)), MIN_CWND);
+    }
+
+    void Bbr::enter(Mode m, int64_t now_us) {
+        mode = m;
+        switch(m) {
+        case STARTUP:
+            pacing_gain = cwnd_gain = HIGH_GAIN;
+            break;
+        case DRAIN:
+            // Empty the queue STARTUP built, at the inverse gain
+            pacing_gain = 1 / HIGH_GAIN;
+            cwnd_gain = HIGH_GAIN;
+            break;
+        case PROBE_BW:
+            // Start anywhere but the draining phase
+            cycle_idx = static_cast<int>((round % (CYCLE_LEN - 1) + 2) % CYCLE_LEN);
+            cycle_us = now_us;
+            pacing_gain = CYCLE_GAINS[cycle_idx];
+            cwnd_gain = 2;
+            break;
+        case PROBE_RTT:
+            pacing_gain = cwnd_gain = 1;
+            if(!in_recovery) {
+                prior_cwnd = CONG_WND;
+            }
+            CONG_WND = std::min(CONG_WND, MIN_CWND);
+            probe_rtt_done_us = 0;
+            break;
+        }
+    }
+
+    void Bbr::on_rtt(int64_t rtt_us, int64_t now_us) {
+        int64_t old_min = min_rtt_us;
+        CongestionControl::on_rtt(rtt_us, now_us);
+        // Windowed min: a sample older than MIN_RTT_WIN_US may be stale after a route change
+        bool is_expired = (min_rtt_stamp_us != 0) && (now_us - min_rtt_stamp_us > MIN_RTT_WIN_US);
+        if((old_min == 0) || (rtt_us <= old_min) || is_expired) {
+            min_rtt_us = std::max<int64_t>(rtt_us, 1);
+            min_rtt_stamp_us = now_us;
+        } else {
+            min_rtt_us = old_min;
+        }
+        if(is_expired && (mode != PROBE_RTT)) {
+            // Drain the queue for a moment to see the path's real propagation delay
+            enter(PROBE_RTT, now_us);
+        }
+    }
+
+    void Bbr::on_ack(const AckSample& s) {
+        if(in_recovery && !s.in_recovery) {
+            // Recovery ended without the sender saying so: the first ACK after a timeout
+            on_recovery_end();
+        }
+        bool is_round_start = false;
+        if(s.prior_delivered >= next_round_delivered) {
+            next_round_delivered = s.delivered;
+            ++round;
+            bw[round % BW_ROUNDS] = 0;
+            is_round_start = true;
+        }
+        // App-limited samples only count when they show more bandwidth than known
+        if((s.delivery_rate > 0) && (!s.is_app_limited || (s.delivery_rate >= btl_bw()))) {
+            bw[round % BW_ROUNDS] = std::max(bw[round % BW_ROUNDS], s.delivery_rate);
+        }
+        bool is_full = (full_bw_cnt >= 3);
+        if(!is_full && is_round_start && !s.is_app_limited) {
+            // The pipe is full once three rounds in a row grew the bandwidth by less than 25%
+            if(btl_bw() >= full_bw * 1.25) {
+                full_bw = btl_bw();
+                full_bw_cnt = 0;
+            } else if(++full_bw_cnt >= 3) {
+                is_full = true;
+            }
+        }
+        switch(mode) {
+        case STARTUP:
+            if(is_full) {
+                enter(DRAIN, s.now_us);
+            }
+            break;
+        case DRAIN:
+            if(s.pipe <= bdp(1)) {
+                enter(PROBE_BW, s.now_us);
+            }
+            break;
+        case PROBE_BW:
+            if(s.now_us - cycle_us > min_rtt_us) {
+                cycle_idx = (cycle_idx + 1) % CYCLE_LEN;
+                cycle_us = s.now_us;
+                pacing_gain = CYCLE_GAINS[cycle_idx];
+            }
+            break;
+        case PROBE_RTT:
+            if((probe_rtt_done_us == 0) && (s.pipe <= MIN_CWND)) {
+                probe_rtt_done_us = s.now_us + PROBE_RTT_US;
+            } else if((probe_rtt_done_us != 0) && (s.now_us >= probe_rtt_done_us)) {
+                min_rtt_stamp_us = s.now_us;
+                enter(is_full ? PROBE_BW : STARTUP, s.now_us);
+                CONG_WND = std::max(CONG_WND, prior_cwnd);
+            }
+            return ;
+        }
+        uint32_t target = bdp(cwnd_gain);
+        if(in_recovery) {
+            // Packet conservation: one out for each one delivered
+            CONG_WND = std::min(std::max(s.pipe + s.acked, MIN_CWND), std::max(target, MIN_CWND));
+        } else if(is_full) {
+            CONG_WND = std::min(CONG_WND + s.acked, target);
+        } else if((CONG_WND < target) || (s.delivered < INIT_CWND)) {
+            CONG_WND += s.acked;
+        }
+        CONG_WND = std::max(CONG_WND, MIN_CWND);
+    }
+
+    void Bbr::on_loss(uint32_t flight, int64_t now_us) {
+        (void)flight;
+        (void)now_us;
+        // Losses do not change the model, only hold the window while they are repaired
+        if(mode != PROBE_RTT) {
+            prior_cwnd = CONG_WND;
+        }
+        in_recovery = true;
+    }
+
+    void Bbr::on_recovery_end() {
+        in_recovery = false;
+        CONG_WND = std::max(CONG_WND, prior_cwnd);
+    }
+
+    void Bbr::on_timeout(uint32_t flight) {
+        (void)flight;
+        if(mode != PROBE_RTT) {
+            prior_cwnd = CONG_WND;
+        }
+        in_recovery = true;
+        CONG_WND = 1;
+    }
+
+    double Bbr::pacing_rate() const {
+        if(btl_bw() > 0) {
+            return pacing_gain * btl_bw();
+        }
+        // No bandwidth sample yet
+        return (srtt_us > 0) ? HIGH_GAIN * CONG_WND * 1e6 / srtt_us : 0;
+    }
+}
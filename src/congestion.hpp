@@ -0,0 +1,131 @@
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include "defs.hpp"
+#include <memory>
+
+namespace jrReliableUDP {
+    enum CongestionAlgorithm {RENO, CUBIC, BBR};
+
+    // What one ACK told the sender, windows in packets
+    struct AckSample {
+        int64_t now_us;
+        uint32_t acked;     // Newly delivered packets, cumulatively or by SACK
+        uint32_t pipe;      // Still in flight after the ACK
+        uint64_t delivered;     // Packets delivered over the connection's life
+        uint64_t prior_delivered;   // delivered when the newest acked packet was sent
+        double delivery_rate;   // Packets per second over that packet's flight, 0 without a sample
+        bool is_app_limited;    // The rate was measured while the sender had too little to send
+        bool is_cwnd_limited;   // The window was full before the ACK, growth is earned
+        bool in_recovery;
+    };
+
+    // Congestion controller of one connection. The sender detects losses and keeps the pipe,
+    // the controller only decides how much may be in flight and how fast it should leave.
+    class CongestionControl {
+    protected:
+        int64_t srtt_us;    // Smoothed the way the controller needs it, 0 before the first sample
+        int64_t min_rtt_us;
+
+    public:
+        static std::unique_ptr<CongestionControl> create(CongestionAlgorithm algo);
+        CongestionControl() : srtt_us(0), min_rtt_us(0) {}
+        virtual ~CongestionControl() {}
+        virtual CongestionAlgorithm algorithm() const = 0;
+        virtual uint32_t cwnd() const = 0;
+        virtual void on_ack(const AckSample& s) = 0;
+        virtual void on_rtt(int64_t rtt_us, int64_t now_us);
+        virtual void on_loss(uint32_t flight, int64_t now_us) = 0;    // Fast retransmit, once per recovery
+        virtual void on_recovery_end() {}
+        virtual void on_timeout(uint32_t flight) = 0;
+        virtual double pacing_rate() const;     // Packets per second, 0 while unknown
+    };
+
+    // RFC 5681 slow start and congestion avoidance with appropriate byte counting, RFC 6582 recovery
+    class Reno : public CongestionControl {
+    private:
+        uint32_t CONG_WND;
+        uint32_t ssthresh;
+        uint32_t acked_cnt;    // Packets acked since last congestion avoidance increment
+
+    public:
+        Reno();
+        CongestionAlgorithm algorithm() const override { return RENO; }
+        uint32_t cwnd() const override { return CONG_WND; }
+        void on_ack(const AckSample& s) override;
+        void on_loss(uint32_t flight, int64_t now_us) override;
+        void on_recovery_end() override { CONG_WND = ssthresh; }
+        void on_timeout(uint32_t flight) override;
+        double pacing_rate() const override;
+    };
+
+    // RFC 9438: cubic growth around the last W_max, never slower than the Reno-friendly estimate
+    class Cubic : public CongestionControl {
+    private:
+        const double C = 0.4;
+        const double BETA = 0.7;
+        double CONG_WND;
+        double ssthresh;
+        double W_max;
+        double W_est;   // Reno-friendly window
+        double K;   // Seconds from the epoch until W_max is reached again
+        double origin;
+        int64_t epoch_us;   // Start of the current congestion avoidance epoch, 0 before it
+
+    public:
+        Cubic();
+        CongestionAlgorithm algorithm() const override { return CUBIC; }
+        uint32_t cwnd() const override { return std::max<uint32_t>(static_cast<uint32_t>(CONG_WND), 1); }
+        void on_ack(const AckSample& s) override;
+        void on_loss(uint32_t flight, int64_t now_us) override;
+        void on_recovery_end() override { CONG_WND = ssthresh; }
+        void on_timeout(uint32_t flight) override;
+        double pacing_rate() const override;
+    };
+
+    // BBR-style model: the window and rate follow the measured bottleneck bandwidth and min RTT, not losses
+    class Bbr : public CongestionControl {
+    private:
+        enum Mode {STARTUP, DRAIN, PROBE_BW, PROBE_RTT};
+        static const int BW_ROUNDS = 10;    // Max filter length in round trips
+        static const int CYCLE_LEN = 8;
+        const double HIGH_GAIN = 2.885;     // 2/ln2, doubles the rate every round
+        const int64_t MIN_RTT_WIN_US = 10000000;
+        const int64_t PROBE_RTT_US = 200000;
+        const uint32_t MIN_CWND = 4;
+
+        Mode mode;
+        double bw[BW_ROUNDS];   // Max delivery rate of each of the last rounds
+        uint64_t round;
+        uint64_t next_round_delivered;  // A round ends once the packet sent at this count is acked
+        double full_bw;     // Plateau detection in STARTUP
+        int full_bw_cnt;
+        int cycle_idx;
+        int64_t cycle_us;
+        int64_t min_rtt_stamp_us;
+        int64_t probe_rtt_done_us;
+        double pacing_gain;
+        double cwnd_gain;
+        uint32_t CONG_WND;
+        uint32_t prior_cwnd;    // Restored after recovery or PROBE_RTT
+        bool in_recovery;
+
+    private:
+        double btl_bw() const;
+        uint32_t bdp(double gain) const;
+        void enter(Mode m, int64_t now_us);
+
+    public:
+        Bbr();
+        CongestionAlgorithm algorithm() const override { return BBR; }
+        uint32_t cwnd() const override { return CONG_WND; }
+        void on_ack(const AckSample& s) override;
+        void on_rtt(int64_t rtt_us, int64_t now_us) override;
+        void on_loss(uint32_t flight, int64_t now_us) override;
+        void on_recovery_end() override;
+        void on_timeout(uint32_t flight) override;
+        double pacing_rate() const override;
+    };
+}
+
+#endif
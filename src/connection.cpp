@@ -0,0 +1,301 @@
+#include "connection.hpp"
+
+namespace jrReliableUDP {
+    Connection::Connection(BatchIO& io, TimerWheel& wheel, const sockaddr_in& peer, bool is_passive_end)
+        : cur_state(is_passive_end ? LISTEN : CLOSED), is_passive_end(is_passive_end), addr(peer), rto(), wheel(wheel),
+          last_rcvd_ms(0), last_data_ms(0), probes_out(0), ticket_out(0), is_resumed(false), is_early(false), sender(addr, rto, io, wheel), recver(addr, io, wheel) {
+        sender.set_timer_handler([this]() { on_rtx_timer(); });
+        // Whatever we send carries the ACK of what we received
+        sender.set_piggyback([this](RawPacket& pkg) { recver.piggyback(pkg); });
+        recver.set_seq_source([this]() { return sender.una(); });
+        // TIME_WAIT->CLOSED
+        linger_timer.set_handler([this]() { set_state(CLOSED); });
+        idle_timer.set_handler([this]() { on_idle_timer(); });
+    }
+
+    void Connection::set_state(ConnectionState s) {
+        cur_state = s;
+#ifdef DEBUG
+        std::cout << states[cur_state] << ":";
+        if(cur_state == CLOSED) {
+            std::cout << std::endl;
+        }
+#endif
+        wake();
+        if(cur_state == ESTABLISHED) {
+            arm_idle_timer();
+        }
+        if(cur_state == CLOSED) {
+            sender.stop_timers();
+            recver.stop_timers();
+            wheel.cancel(linger_timer);
+            wheel.cancel(idle_timer);
+            if(close_handler) {
+                close_handler();
+            }
+        }
+    }
+
+    void Connection::update_state() {
+        ConnectionState old_state;
+        do {
+            old_state = cur_state;
+            switch(cur_state) {
+            case LISTEN:
+                // Peer's SYN arrived, answer with ours(LISTEN->SYN_RCVD)
+                if(recver.rcvd_syn()) {
+                    open();
+                }
+                break;
+            case SYN_SENT:
+            case SYN_RCVD:
+                // Our SYN acked and the peer's received(SYN_SENT/SYN_RCVD->ESTABLISHED); with a valid ticket
+                // the peer's SYN is enough, the ACK of ours may come with its data
+                if((sender.is_all_acked() || is_resumed) && recver.rcvd_syn()) {
+                    sender.start_pmtud(std::min(opts.mss, recver.peer_mss()));
+                    sender.set_init_credit(recver.peer_stream_buf());
+                    set_state(ESTABLISHED);
+                }
+                break;
+            case ESTABLISHED:
+                // Peer's FIN arrived(ESTABLISHED->CLOSE_WAIT)
+                if(recver.rcvd_fin()) {
+                    set_state(CLOSE_WAIT);
+                }
+                break;
+            case FIN_WAIT:
+                // Our FIN acked and the peer's received(FIN_WAIT->TIME_WAIT)
+                if(sender.is_all_acked() && recver.rcvd_fin()) {
+                    // Long enough for the peer to retransmit its FIN a few times
+                    wheel.schedule(linger_timer, get_now_ms() + std::max<int64_t>(TIME_WAIT_MS, 3 * rto.timeout_ms()));
+                    set_state(TIME_WAIT);
+                }
+                break;
+            case LAST_ACK:
+                // Our FIN acked(LAST_ACK->CLOSED)
+                if(sender.is_all_acked()) {
+                    set_state(CLOSED);
+                }
+                break;
+            default:
+                break;
+            }
+        } while(old_state != cur_state);
+    }
+
+    void Connection::set_options(const ConnectionOptions& o) {
+        if(o.congestion != opts.congestion) {
+            sender.set_congestion(o.congestion);
+        }
+        sender.set_pacing(o.pacing);
+        sender.set_nodelay(o.nodelay);
+        recver.set_ack_policy(o.ack_every, o.ack_delay_ms);
+        recver.set_buffer(o.rcv_buf);
+        recver.set_stream_buffer(o.stream_buf);
+        if((o.mss != opts.mss) && ((cur_state == ESTABLISHED) || (cur_state == CLOSE_WAIT))) {
+            // The peer keeps what it learned from our SYN, only our own packets follow the new limit
+            sender.start_pmtud(std::min(o.mss, recver.peer_mss()));
+        }
+        bool is_idle_changed = (o.keepalive_ms != opts.keepalive_ms) || (o.idle_timeout_ms != opts.idle_timeout_ms);
+        opts = o;
+        if(is_idle_changed) {
+            arm_idle_timer();
+        }
+    }
+
+    void Connection::arm_idle_timer() {
+        if(((cur_state != ESTABLISHED) && (cur_state != CLOSE_WAIT)) || ((opts.keepalive_ms <= 0) && (opts.idle_timeout_ms <= 0))) {
+            wheel.cancel(idle_timer);
+            return ;
+        }
+        int64_t now = get_now_ms();
+        last_rcvd_ms = last_data_ms = now;
+        probes_out = 0;
+        int64_t first = (opts.keepalive_ms > 0) ? opts.keepalive_ms : opts.idle_timeout_ms;
+        if(opts.idle_timeout_ms > 0) {
+            first = std::min(first, opts.idle_timeout_ms);
+        }
+        wheel.schedule(idle_timer, now + first);
+    }
+
+    void Connection::on_idle_timer() {
+        if((cur_state != ESTABLISHED) && (cur_state != CLOSE_WAIT)) {
+            // Closing: the FIN's retransmissions find out whether the peer is still there
+            return ;
+        }
+        int64_t now = get_now_ms();
+        int64_t due = INT64_MAX;
+        if(opts.idle_timeout_ms > 0) {
+            int64_t idle_until = std::max(last_data_ms, sender.last_sent_ms()) + opts.idle_timeout_ms;
+            if(idle_until <= now) {
+                // Nobody uses it: tell the peer, if it is there at all, and free it
+                sender.send_RST();
+                fail("Connection idle timeout.");
+                return ;
+            }
+            due = idle_until;
+        }
+        if(opts.keepalive_ms > 0) {
+            bool is_heard = (now - last_rcvd_ms < opts.keepalive_ms);
+            if(is_heard || !sender.is_all_acked()) {
+                // Heard from lately, or an ACK is awaited anyway and the retransmission timer gives up on a dead peer
+                due = std::min(due, is_heard ? last_rcvd_ms + opts.keepalive_ms : now + opts.keepalive_ms);
+            } else if(probes_out >= opts.keepalive_probes) {
+                fail("Connection timed out, keepalive probes unanswered.");
+                return ;
+            } else {
+                sender.send_keepalive();
+                ++probes_out;
+                due = std::min(due, now + opts.keepalive_interval_ms);
+            }
+        }
+        wheel.schedule(idle_timer, due);
+    }
+
+    SynOptions Connection::syn_options() {
+        SynOptions o;
+        o.mss = opts.mss;
+        o.has_wscale = true;
+        o.wscale = recver.announce_wscale();
+        o.stream_buf = recver.stream_credit();
+        o.ticket = ticket_out;
+        return o;
+    }
+
+    void Connection::open() {
+        // Send SYN and ISN
+        set_state(is_passive_end ? SYN_RCVD : SYN_SENT);
+        sender.send_SYN(syn_options(), recver.buffer());
+    }
+
+    void Connection::restore(uint32_t cookie, uint32_t peer_isn, const SynOptions& peer, uint16_t wnd_sent) {
+        // LISTEN->ESTABLISHED: our SYN was the cookie and the peer acked it, its own SYN was seen at peer_isn
+        sender.set_isn(cookie + 1);
+        recver.restore_syn(peer_isn, peer, wnd_sent);
+        sender.set_wscale(recver.peer_wscale());
+        sender.start_pmtud(std::min(opts.mss, recver.peer_mss()));
+        sender.set_init_credit(recver.peer_stream_buf());
+        set_state(ESTABLISHED);
+    }
+
+    void Connection::resume(const ResumptionTicket& t) {
+        // CLOSED->ESTABLISHED: the ticket stands in for the peer's SYN until that comes
+        is_early = true;
+        if(t.srtt_us > 0) {
+            // As a first sample, so the SYN and the data with it aren't held to the initial RTO
+            rto.update(t.srtt_us);
+        }
+        sender.set_wscale(t.wscale);
+        sender.set_init_credit(t.stream_buf);
+        sender.start_pmtud(std::min(opts.mss, t.mss), t.path_mss);
+        SynOptions o = syn_options();
+        o.ticket = t.token;
+        set_state(ESTABLISHED);
+        sender.open_window(t.wnd);
+        sender.send_SYN(o, recver.buffer());
+    }
+
+    void Connection::accept_resumption(uint32_t wnd) {
+        is_resumed = true;
+        // The ticket shows the peer completed a handshake from its address before, so it is answered with data
+        // right away, as far as its SYN's window and our initial congestion window go
+        sender.open_window(wnd);
+    }
+
+    ResumptionTicket Connection::ticket() const {
+        ResumptionTicket t;
+        t.token = recver.peer_ticket();
+        t.mss = std::min(opts.mss, recver.peer_mss());
+        t.path_mss = sender.get_mss();
+        t.wscale = recver.peer_wscale();
+        t.wnd = std::max<uint32_t>(sender.peer_window(), 1);
+        t.stream_buf = recver.peer_stream_buf();
+        t.srtt_us = (rto.srtt == -1) ? 0 : (rto.srtt >> 3);
+        return t;
+    }
+
+    void Connection::close() {
+        if(cur_state == ESTABLISHED) {
+            // ESTABLISHED->FIN_WAIT
+            set_state(FIN_WAIT);
+        } else if(cur_state == CLOSE_WAIT) {
+            // CLOSE_WAIT->LAST_ACK
+            set_state(LAST_ACK);
+        } else {
+            return ;
+        }
+        sender.reset_WND();
+        sender.send_FIN();
+    }
+
+    void Connection::on_packet(const RawPacket& pkg) {
+        if(cur_state == CLOSED) {
+            return ;
+        }
+        if(idle_timer.is_armed()) {
+            // Only while someone looks. A keepalive probe, like any duplicate, is old data and doesn't count as use.
+            last_rcvd_ms = get_now_ms();
+            if(IS_DATA(pkg.type) && !seq_lt(pkg.seq_num, recver.ack_num())) {
+                last_data_ms = last_rcvd_ms;
+            }
+            probes_out = 0;
+        }
+        if(IS_RST(pkg.type)) {
+            // RST arrived
+            fail("Connection reset by peer.");
+            return ;
+        }
+        if(IS_PROBE(pkg.type)) {
+            // Path MTU probes stay out of both windows
+            if(IS_ACK(pkg.type)) {
+                sender.on_probe_ack(pkg);
+            } else {
+                recver.on_probe(pkg);
+            }
+            return ;
+        }
+        if(IS_ACK(pkg.type)) {
+            sender.on_ack(pkg);
+        }
+        if(pkg.type != ACK) {
+            // Peer's SYN, FIN or data
+            recver.on_packet(pkg);
+        }
+        if(recver.rcvd_syn()) {
+            // Known once the peer's SYN is in
+            sender.set_wscale(recver.peer_wscale());
+        }
+        if(is_early && recver.rcvd_syn()) {
+            // What the peer announces now replaces what the ticket kept
+            is_early = false;
+            sender.start_pmtud(std::min(opts.mss, recver.peer_mss()), sender.get_mss());
+            sender.set_init_credit(recver.peer_stream_buf());
+        }
+        update_state();
+        wake();
+    }
+
+    void Connection::wake() {
+        if(wake_handler && waiters.post()) {
+            wake_handler();
+        }
+    }
+
+    void Connection::on_rtx_timer() {
+        try {
+            sender.on_timer();
+        } catch(const std::runtime_error& e) {
+            if((cur_state == LAST_ACK) || (cur_state == TIME_WAIT) || ((cur_state == FIN_WAIT) && recver.rcvd_fin())) {
+                // The peer is gone after taking our FIN, its ACK was lost
+                set_state(CLOSED);
+            } else {
+                fail(e.what());
+            }
+        }
+    }
+
+    void Connection::fail(const std::string& msg) {
+        error = msg;
+        set_state(CLOSED);
+    }
+}
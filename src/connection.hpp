@@ -0,0 +1,154 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "recver.hpp"
+#include "sender.hpp"
+#include <vector>
+
+namespace jrReliableUDP {
+    enum ConnectionState {CLOSED, SYN_SENT, LISTEN, SYN_RCVD, ESTABLISHED,
+                          FIN_WAIT, TIME_WAIT, CLOSE_WAIT, LAST_ACK};
+
+    // Per-connection tunables; an endpoint hands its current ones to every connection it starts
+    struct ConnectionOptions {
+        CongestionAlgorithm congestion;
+        PacingMode pacing;
+        uint32_t ack_every;     // In-order packets per ACK
+        int64_t ack_delay_ms;   // Longest wait for the next one
+        uint16_t mss;   // Largest payload per datagram either way, announced in our SYN
+        uint32_t snd_buf;   // Packets queued or in flight before sending blocks
+        uint32_t rcv_buf;   // Receive window, its scale is fixed by the value at the handshake
+        uint32_t stream_buf;    // Unread packets of one stream before its sender waits, 0 for rcv_buf
+        bool nodelay;   // Stream mode without Nagle
+        int64_t keepalive_ms;   // Silence from the peer before it is probed, 0 for no keepalive
+        int64_t keepalive_interval_ms;  // Between unanswered probes
+        int keepalive_probes;   // Unanswered probes before the connection fails
+        int64_t idle_timeout_ms;    // No data either way for this long aborts the connection, 0 for never
+
+        ConnectionOptions()
+            : congestion(RENO), pacing(PACING_OFF), ack_every(ACK_EVERY), ack_delay_ms(ACK_DELAY_MS), mss(MAX_SIZE),
+              snd_buf(DEFAULT_SND_BUF), rcv_buf(DEFAULT_RCV_BUF), stream_buf(0), nodelay(false), keepalive_ms(0),
+              keepalive_interval_ms(KEEPALIVE_INTERVAL_MS), keepalive_probes(KEEPALIVE_PROBES), idle_timeout_ms(0) {}
+    };
+
+    // What a client keeps of a connection to resume the next one to the same server in 0-RTT: the server's token
+    // and what the last handshake negotiated and the path showed, so data can go with the SYN
+    struct ResumptionTicket {
+        uint64_t token;     // The server's, 0 if it issued none
+        uint16_t mss;   // Negotiated, the ceiling of the PMTU search
+        uint16_t path_mss;  // Largest payload found to get through
+        uint8_t wscale;     // The server's window scale
+        uint32_t wnd;   // Largest window the server advertised, packets
+        uint32_t stream_buf;    // Its initial credit of each stream
+        int64_t srtt_us;    // 0 without an RTT sample
+
+        ResumptionTicket() : token(0), mss(BASE_MSS), path_mss(BASE_MSS), wscale(0), wnd(1), stream_buf(DEFAULT_RCV_BUF), srtt_us(0) {}
+        bool valid() const { return token != 0; }
+    };
+
+    // Completion handlers parked on a connection or endpoint. The loop re-checks them after anything that may have
+    // changed what they wait for, never on every round.
+    class Waiters {
+    private:
+        std::vector<std::function<bool()>> ops;     // true once the operation completed and called its handler
+        bool is_posted;     // A check is already due this round
+        bool is_polling;    // What the handlers change still needs a check, even with every op taken out
+
+    public:
+        Waiters() : is_posted(false), is_polling(false) {}
+        void add(std::function<bool()> op) { ops.push_back(op); }
+        // true if a check has to be scheduled, at most once per round
+        bool post() {
+            if((ops.empty() && !is_polling) || is_posted) {
+                return false;
+            }
+            is_posted = true;
+            return true;
+        }
+        void poll() {
+            is_posted = false;
+            // In order, so reads of one stream complete as they were issued; handlers may add more, checked next time
+            std::vector<std::function<bool()>> due;
+            due.swap(ops);
+            std::vector<std::function<bool()>> kept;
+            is_polling = true;
+            for(auto& op : due) {
+                if(!op()) {
+                    kept.push_back(std::move(op));
+                }
+            }
+            is_polling = false;
+            for(auto& op : ops) {
+                kept.push_back(std::move(op));
+            }
+            ops.swap(kept);
+        }
+    };
+
+    // One peer of an endpoint: its state machine, send and receive windows.
+    // Driven entirely by the reactor's loop, nothing here blocks or reads the socket.
+    class Connection {
+    private:
+        ConnectionState cur_state;
+        bool is_passive_end;
+        sockaddr_in addr;   // Peer address
+        RTO rto;    // Timeout retransmit parameters
+        TimerWheel& wheel;
+        Timer linger_timer;     // TIME_WAIT expiry
+        // Keepalive and idle timeout share one timer. Packets only note the time while it is armed; it is pushed back
+        // when it fires, not on every packet, so an idle connection costs one wheel slot and nothing per packet.
+        Timer idle_timer;
+        int64_t last_rcvd_ms;   // Anything from the peer
+        int64_t last_data_ms;   // Data from the peer; ours is Sender::last_sent_ms
+        int probes_out;     // Keepalive probes unanswered
+        std::string error;  // Why the connection was torn down, empty on a clean close
+        std::function<void()> close_handler;
+        std::function<void()> wake_handler;
+        ConnectionOptions opts;
+        uint64_t ticket_out;    // Token our SYN hands the peer, 0 for none
+        bool is_resumed;    // Passive: the peer's SYN carried a valid ticket, no need to wait for our SYN's ACK
+        bool is_early;  // Active: went ahead on a ticket, the peer's SYN is still to come
+
+    public:
+        Sender sender;
+        Recver recver;
+        Waiters waiters;    // Asynchronous operations on this connection
+
+    private:
+        void set_state(ConnectionState s);
+        void update_state();
+        void on_rtx_timer();
+        void arm_idle_timer();  // From now on, if the options ask for it
+        void on_idle_timer();
+        SynOptions syn_options();   // What our SYN announces, our window scale fixed from now on
+
+    public:
+        Connection(BatchIO& io, TimerWheel& wheel, const sockaddr_in& peer, bool is_passive_end);
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+        ConnectionState state() const { return cur_state; }
+        bool passive() const { return is_passive_end; }
+        const sockaddr_in& peer() const { return addr; }
+        const std::string& last_error() const { return error; }
+        bool is_finished() const { return cur_state == CLOSED; }    // The reactor may drop it
+        void set_close_handler(std::function<void()> handler) { close_handler = handler; }
+        void set_wake_handler(std::function<void()> handler) { wake_handler = handler; }    // Schedules a check of the waiters
+        void wake();    // Something changed, have the waiters checked
+        const ConnectionOptions& options() const { return opts; }
+        void set_options(const ConnectionOptions& o);   // A new congestion algorithm starts from its initial window
+        void open();    // Send our SYN, CLOSED->SYN_SENT (active) or LISTEN->SYN_RCVD (passive)
+        // Passive end whose handshake a SYN cookie carried, straight to ESTABLISHED
+        void restore(uint32_t cookie, uint32_t peer_isn, const SynOptions& peer, uint16_t wnd_sent);
+        // Active end: send our SYN with the ticket and go ESTABLISHED at once, data may follow it in the first flight
+        void resume(const ResumptionTicket& t);
+        void issue_ticket(uint64_t token) { ticket_out = token; }   // Before open
+        // Passive end whose peer presented a valid ticket: ESTABLISHED once its SYN is in, sending up to wnd at once
+        void accept_resumption(uint32_t wnd);
+        ResumptionTicket ticket() const;    // What a later connection to this peer may resume with
+        void close();   // Send our FIN once everything queued before it
+        void on_packet(const RawPacket& pkg);
+        void fail(const std::string& msg);
+    };
+}
+
+#endif
@@ -5,8 +5,101 @@ namespace jrReliableUDP {
         return msg + ":" + strerror(errno);
     }
 
-    int64_t get_time_diff_from_now_ms(int64_t start) {
-        auto end = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch());
-        return std::chrono::duration_cast<std::chrono::milliseconds>(end - std::chrono::duration<int64_t, std::milli>(start)).count();
+    int64_t get_now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    int64_t get_now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void RawPacket::encode_header(char* hdr) const {
+        uint32_t seq = htonl(seq_num);
+        uint32_t ack = htonl(ack_num);
+        uint16_t wnd = htons(win_size);
+        uint32_t tsval = htonl(ts_val);
+        uint32_t tsecr = htonl(ts_ecr);
+        uint32_t sn = htonl(ssn);
+        uint16_t n = htons(len);
+        ::memcpy(hdr, &seq, 4);
+        ::memcpy(hdr + 4, &ack, 4);
+        ::memcpy(hdr + 8, &wnd, 2);
+        hdr[10] = static_cast<char>(type);
+        hdr[11] = static_cast<char>(stream);
+        ::memcpy(hdr + 12, &tsval, 4);
+        ::memcpy(hdr + 16, &tsecr, 4);
+        ::memcpy(hdr + 20, &sn, 4);
+        ::memcpy(hdr + 24, &n, 2);
+    }
+
+    SynOptions::SynOptions(const RawPacket& syn) : SynOptions() {
+        if(syn.len >= 2) {
+            uint16_t n;
+            ::memcpy(&n, syn.payload(), 2);
+            mss = std::min<uint16_t>(ntohs(n), MAX_SIZE);
+        }
+        if(syn.len >= 3) {
+            wscale = std::min<uint8_t>(static_cast<uint8_t>(syn.payload()[2]), MAX_WSCALE);
+            has_wscale = true;
+        }
+        if(syn.len >= 7) {
+            uint32_t n;
+            ::memcpy(&n, syn.payload() + 3, 4);
+            stream_buf = std::max<uint32_t>(ntohl(n), 1);
+        }
+        if(syn.len >= 15) {
+            uint32_t hi, lo;
+            ::memcpy(&hi, syn.payload() + 7, 4);
+            ::memcpy(&lo, syn.payload() + 11, 4);
+            ticket = (static_cast<uint64_t>(ntohl(hi)) << 32) | ntohl(lo);
+        }
+    }
+
+    size_t SynOptions::encode(char* out) const {
+        uint16_t n = htons(mss);
+        uint32_t credit = htonl(stream_buf);
+        ::memcpy(out, &n, 2);
+        out[2] = static_cast<char>(wscale);
+        ::memcpy(out + 3, &credit, 4);
+        if(ticket == 0) {
+            return 7;
+        }
+        uint32_t hi = htonl(static_cast<uint32_t>(ticket >> 32));
+        uint32_t lo = htonl(static_cast<uint32_t>(ticket));
+        ::memcpy(out + 7, &hi, 4);
+        ::memcpy(out + 11, &lo, 4);
+        return SYN_OPTIONS_SIZE;
+    }
+
+    bool RawPacket::decode(const PacketBuf& buf, size_t off, size_t n) {
+        if(n < HEADER_SIZE) {
+            return false;
+        }
+        const char* hdr = buf.data() + off;
+        uint32_t seq, ack, tsval, tsecr, sn;
+        uint16_t wnd, pkg_len;
+        ::memcpy(&seq, hdr, 4);
+        ::memcpy(&ack, hdr + 4, 4);
+        ::memcpy(&wnd, hdr + 8, 2);
+        ::memcpy(&tsval, hdr + 12, 4);
+        ::memcpy(&tsecr, hdr + 16, 4);
+        ::memcpy(&sn, hdr + 20, 4);
+        ::memcpy(&pkg_len, hdr + 24, 2);
+        pkg_len = ntohs(pkg_len);
+        if((pkg_len > MAX_SIZE) || (static_cast<size_t>(pkg_len) > n - HEADER_SIZE)) {
+            return false;
+        }
+        seq_num = ntohl(seq);
+        ack_num = ntohl(ack);
+        win_size = ntohs(wnd);
+        type = static_cast<uint8_t>(hdr[10]);
+        stream = static_cast<uint8_t>(hdr[11]);
+        ts_val = ntohl(tsval);
+        ts_ecr = ntohl(tsecr);
+        ssn = ntohl(sn);
+        len = pkg_len;
+        this->off = off + HEADER_SIZE;
+        this->buf = len ? buf : PacketBuf();
+        return true;
     }
 }
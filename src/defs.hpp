@@ -1,29 +1,67 @@
 #ifndef DEFS_H
 #define DEFS_H
 
-#include <map>
+#include "pool.hpp"
+#include <algorithm>
 #include <string>
 #include <chrono>
 #include <cstring>
+#include <cstdlib>
 #include <cstdint>
 #include <stdexcept>
 #include <netdb.h>
+#include <arpa/inet.h>
 #include <sys/socket.h>
 
-#define DATA (0)
+#define DATA (16)   // Carries user data, so a data packet can piggyback an ACK
 #define RST (1)
 #define SYN (4)
 #define FIN (2)
 #define ACK (8)
-#define DEFAULT_MSS (1460)
+#define MORE (32)   // More fragments of the same message follow this data packet
+#define PROBE (64)  // PMTU probe: padding, unsequenced, SEQ holds its payload size; echoed with ACK set
+#define SKIP (128)  // Data abandoned by a partially reliable sender: payload dropped, the receiver skips its place
 #define DUPTHRESH (3)
-#define MAX_SIZE (512)
-#define RTO_INIT (1)
+#define INIT_CWND (10)     // Packets, RFC 6928
+#define PACING_BURST (2)    // Packets the pacing token bucket lets out back to back at low rates
+#define MAX_SACK_BLOCKS (4)    // [start, end) SEQ pairs carried in an ACK's payload
+#define HEADER_SIZE (26)    // SEQ 4, ACK 4, WND 2, TYPE 1, STREAM 1, TSVAL 4, TSECR 4, SSN 4, LEN 2
+#define IP_UDP_SIZE (28)    // IPv4 header without options and UDP header
+#define BASE_MSS (1200 - IP_UDP_SIZE - HEADER_SIZE)     // RFC 8899 BASE_PLPMTU, taken to pass any path
+#define MAX_SIZE (9000 - IP_UDP_SIZE - HEADER_SIZE)     // Payload of a jumbo frame, the most one packet carries
+#define MAX_PROBES (3)  // Lost PMTU probes of one size before it is given up, RFC 8899
+#define PMTU_RAISE_MS (600000)  // Search for a larger PMTU again after this long, RFC 8899 PMTU_RAISE_TIMER
+#define RTO_INIT (1000000)  // us, RFC 6298 initial RTO until the first RTT sample
+#define RTO_MIN (10000)     // us, well above the 1 ms timer tick and wakeup jitter, so LAN links don't retransmit spuriously
+#define RTO_MAX (60000000)  // us
+#define RTO_G (1000)    // us, clock granularity G: timers tick in ms
+#define DEFAULT_SND_BUF (1024)  // Packets queued or in flight before Socket::send_pkg blocks
+#define DEFAULT_RCV_BUF (256)   // Packets the receive window holds
+#define DGRAM_STREAM (255)  // Unreliable datagrams: delivered as they arrive, never retransmitted
+#define MAX_WSCALE (14)     // Largest window scale shift, RFC 7323
+#define SOCK_BUF_SIZE (4 << 20)     // Bytes asked for SO_SNDBUF/SO_RCVBUF, the kernel caps it at [rw]mem_max
+#define PERSIST_MAX (60000)     // Longest interval between zero window probes, in ms
+#define ACK_EVERY (2)  // In-order packets per ACK, RFC 5681
+#define ACK_DELAY_MS (5)    // Longest a lone in-order packet waits for its ACK by default
+#define MAX_ACK_DELAY_MS (10)   // Upper bound of any receiver's ACK delay, every RTO allows for it
+#define TIME_WAIT_MS (100)  // Least linger after an active close, re-ACKing the peer's retransmitted FIN
+#define KEEPALIVE_INTERVAL_MS (75000)  // Between unanswered keepalive probes by default, as TCP's tcp_keepalive_intvl
+#define KEEPALIVE_PROBES (9)    // Unanswered probes before the peer is given up by default, as tcp_keepalive_probes
+#define IO_BATCH (32)   // Datagrams per sendmmsg/recvmmsg
+#define RING_INIT_SIZE (64)     // Initial slots of a send/receive window ring, grows by doubling
+#define SYN_OPTIONS_SIZE (15)   // SYN payload: MSS 2, window scale 1, stream credit 4, resumption ticket 8 if any
+#define COOKIE_SLOT_MS (1 << 16)    // A SYN cookie stays valid for one to two slots of about a minute
+#define TICKET_LIFETIME_MS (3600000)    // How long a server takes back the resumption tickets it issued
+#define HANDOFF_RING_SIZE (256)     // Messages or fragments each way between an application thread and an IoThread
 
 #define IS_ACK(type) ((type&ACK) == ACK)
 #define IS_SYN(type) ((type&SYN) == SYN)
 #define IS_FIN(type) ((type&FIN) == FIN)
 #define IS_RST(type) ((type&RST) == RST)
+#define IS_DATA(type) ((type&DATA) == DATA)
+#define IS_MORE(type) ((type&MORE) == MORE)
+#define IS_PROBE(type) ((type&PROBE) == PROBE)
+#define IS_SKIP(type) ((type&SKIP) == SKIP)
 
 #define DEBUG
 //#define TIMEOUT_TRANSMIT_DEBUG
@@ -37,78 +75,105 @@
 namespace jrReliableUDP {
     using uint = unsigned int;
 
+    int64_t get_now_ms();   // Steady clock, the time base of timers
+    int64_t get_now_us();   // Same clock, packet timestamps are its low 32 bits
+
 #ifdef DEBUG
         static std::vector<std::string> states = {"CLOSED", "SYN_SENT", "LISTEN", "SYN_RCVD", "ESTABLISHED",
                                            "FIN_WAIT", "TIME_WAIT", "CLOSE_WAIT", "LAST_ACK"};
 #endif
 
+    // RFC 6298 estimator in microseconds, fixed point like the kernel's: srtt is kept scaled by 8, rttvar by 4
     struct RTO {
-      int64_t RTO_ms;
-      int64_t srtt;
-      int64_t rttvar;
+      int64_t RTO_us;
+      int64_t srtt;   // 8 * SRTT, -1 before the first sample
+      int64_t rttvar; // 4 * RTTVAR
       int64_t backoff_factor;
-      const int64_t RTO_G_INDEX = 3;
-      const int64_t RTO_H_INDEX = 2;
 
-      RTO(int64_t a, int64_t b, int64_t c) : RTO_ms(a), srtt(b), rttvar(c), backoff_factor(1) {}
+      RTO() : RTO_us(RTO_INIT), srtt(-1), rttvar(0), backoff_factor(1) {}
 
-      void update_RTO_ms(int64_t rtts) {
+      void update(int64_t rtt_us) {
           this->backoff_factor = 1;
           if(this->srtt == -1) {
-              this->srtt = rtts;
-              this->rttvar = rtts/2;
+              // SRTT = R, RTTVAR = R/2
+              this->srtt = rtt_us << 3;
+              this->rttvar = rtt_us << 1;
           } else {
-              int64_t g = (2 >> RTO_G_INDEX);
-              int64_t h = (2 >> RTO_H_INDEX);
-              this->srtt = (1 - g) * this->srtt + g * rtts;
-              this->rttvar = (1 - h) * this->rttvar + h * std::abs(rtts - this->srtt);
+              // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+              int64_t err = rtt_us - (this->srtt >> 3);
+              this->rttvar += std::abs(err) - (this->rttvar >> 2);
+              this->srtt += err;
           }
-          this->RTO_ms = this->srtt + 4 * this->rttvar;
-      }   // Calc RTO in ms
+          // RTO = SRTT + max(G, 4 * RTTVAR), plus the peer's ACK delay as in QUIC: a lone packet's ACK may wait that long
+          int64_t rto_us = (this->srtt >> 3) + std::max<int64_t>(RTO_G, this->rttvar) + MAX_ACK_DELAY_MS * 1000;
+          this->RTO_us = std::min<int64_t>(std::max<int64_t>(rto_us, RTO_MIN), RTO_MAX);
+      }
+
+      int64_t timeout_ms() const {
+          // Backed off, rounded up to the timer tick
+          return (std::min<int64_t>(this->RTO_us * this->backoff_factor, RTO_MAX) + 999) / 1000;
+      }
     };
 
     struct RawPacket {
         uint32_t seq_num;
         uint32_t ack_num;
         uint16_t win_size;  // flow control sliding window size
-        uint type:4;    // 4 bit flag: ACK, SYN, FIN, RST
-        uint mss:12;
-        int64_t timestamp;
-        char data[MAX_SIZE];
+        uint8_t type;   // Flags: SKIP, PROBE, MORE, DATA, ACK, SYN, FIN, RST
+        uint8_t stream;     // Stream of a data packet; in a pure ACK, the one whose credit ssn is
+        uint32_t ts_val;    // Send time in us, set at each transmission
+        uint32_t ts_ecr;    // Echo of the ts_val that last advanced the peer's ACK, 0 if none
+        uint32_t ssn;   // Sequence within the stream of a data packet; in a pure ACK, the first SSN it may not send
+        uint16_t len;   // Payload length
+        uint32_t off;   // Payload offset in buf
+        PacketBuf buf;  // Pooled payload, shared instead of copied
+
+        RawPacket() : seq_num(0), ack_num(0), win_size(0), type(DATA), stream(0), ts_val(0), ts_ecr(0), ssn(0), len(0), off(0) {}
 
-        RawPacket() {}
+        RawPacket(uint32_t seq_num, uint32_t ack_num, uint16_t win_size, uint type, const std::string& data="")
+            : RawPacket(seq_num, ack_num, win_size, type, data.data(), data.size()) {}
 
-        RawPacket(uint32_t seq_num, uint32_t ack_num, uint16_t win_size, uint type, const std::string& data="") {
+        RawPacket(uint32_t seq_num, uint32_t ack_num, uint16_t win_size, uint type, const char* data, size_t n) {
             this->seq_num = seq_num;
             this->ack_num = ack_num;
             this->win_size = win_size;
             this->type = type;
-            this->mss = DEFAULT_MSS;
-            this->timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
-            ::strcpy(this->data, data.data());
+            this->stream = 0;
+            this->ts_val = static_cast<uint32_t>(get_now_us());
+            this->ts_ecr = 0;
+            this->ssn = 0;
+            this->len = static_cast<uint16_t>(std::min<size_t>(n, MAX_SIZE));
+            this->off = 0;
+            if(this->len > 0) {
+                // The only copy of the payload on the sending side
+                this->buf = PacketPool::fit(this->len).alloc();
+                ::memcpy(this->buf.data(), data, this->len);
+            }
         }
 
-        RawPacket(const RawPacket& pkg)
-            : seq_num(pkg.seq_num), ack_num(pkg.ack_num),
-              win_size(pkg.win_size), type(pkg.type), mss(pkg.mss), timestamp(pkg.timestamp) {
-            ::memmove(data, pkg.data, MAX_SIZE);
-        }
+        const char* payload() const { return len ? buf.data() + off : ""; }
+        void encode_header(char* hdr) const;    // Serialize the HEADER_SIZE header in network byte order
+        bool decode(const PacketBuf& buf, size_t off, size_t n);  // Parse the datagram at buf+off, payload is referenced not copied
+    };
 
-        RawPacket& operator=(const RawPacket& pkg) {
-            seq_num = pkg.seq_num;
-            ack_num = pkg.ack_num;
-            win_size = pkg.win_size;
-            type = pkg.type;
-            mss = pkg.mss;
-            timestamp = pkg.timestamp;
-            ::memmove(data, pkg.data, MAX_SIZE);
-            return *this;
-        }
+    // What a SYN announces in its payload
+    struct SynOptions {
+        uint16_t mss;   // Largest payload taken per packet
+        bool has_wscale;
+        uint8_t wscale;     // Shift of every later window field
+        uint32_t stream_buf;    // Initial credit of each stream, packets
+        uint64_t ticket;    // Resumption ticket: issued by a listener, presented back by a client; 0 for none
+
+        SynOptions() : mss(BASE_MSS), has_wscale(false), wscale(0), stream_buf(DEFAULT_RCV_BUF), ticket(0) {}
+        explicit SynOptions(const RawPacket& syn);  // What of it the payload carries, defaults for the rest
+        size_t encode(char* out) const;     // Up to SYN_OPTIONS_SIZE bytes, the ticket only if there is one
     };
 
-    std::string error_msg(std::string msg);
+    // SEQ comparison that survives 32 bit wraparound
+    inline bool seq_lt(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+    inline bool seq_le(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) <= 0; }
 
-    int64_t get_time_diff_from_now_ms(int64_t start);
+    std::string error_msg(std::string msg);
 }
 
 #endif
@@ -0,0 +1,252 @@
+#include "io.hpp"
+
+namespace jrReliableUDP {
+    const size_t BatchIO::GSO_MAX_SEGS;
+    const size_t BatchIO::GSO_MAX_BYTES;
+
+    BatchIO::BatchIO(int sockfd, size_t batch)
+        : sockfd(sockfd), batch(0), n_pending(0), gso(false), gro(false), txtime(false) {
+        set_batch(batch);
+    }
+
+    void BatchIO::set_batch(size_t batch) {
+        flush();
+        // What the kernel had no room for is dropped with the old arrays, like datagrams lost on the way
+        for(size_t i = 0; i < n_pending; ++i) {
+            spays[i] = PacketBuf();
+        }
+        n_pending = 0;
+        this->batch = std::max<size_t>(batch, 1);
+        hbuf.assign(this->batch * HEADER_SIZE, 0);
+        spays.resize(this->batch);
+        spay_offs.resize(this->batch);
+        slens.resize(this->batch);
+        stxtimes.resize(this->batch);
+        sfirst.resize(this->batch + 1);
+        saddrs.resize(this->batch);
+        rslots.resize(this->batch);
+        raddrs.resize(this->batch);
+        siovs.resize(2 * this->batch);
+        riovs.resize(this->batch);
+        smsgs.resize(this->batch);
+        rmsgs.resize(this->batch);
+        sctrl.assign(this->batch * sctrl_words(), 0);
+        rctrl.assign(this->batch * ctrl_words(), 0);
+        rsegs.clear();
+    }
+
+    bool BatchIO::set_offload(bool on) {
+        flush();
+        // Probe the kernel: setting the options fails with ENOPROTOOPT where they are unsupported
+        int seg = 0;
+        gso = on && (0 == ::setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg)));
+        int val = on ? 1 : 0;
+        gro = (0 == ::setsockopt(sockfd, SOL_UDP, UDP_GRO, &val, sizeof(val))) && on;
+        return gso || gro;
+    }
+
+    bool BatchIO::set_txtime(bool on) {
+        flush();
+        sock_txtime cfg;
+        cfg.clockid = CLOCK_MONOTONIC;
+        cfg.flags = 0;
+        // Turning it off is just not attaching departure times any more
+        txtime = on && (0 == ::setsockopt(sockfd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)));
+        return txtime;
+    }
+
+    size_t BatchIO::prepare_send(size_t first) {
+        // Point the headers at the buffers on every call rather than once, so copies of a BatchIO stay valid
+        size_t n_msgs = 0;
+        for(size_t i = first; i < n_pending; ++n_msgs) {
+            size_t j = i + 1;
+            size_t bytes = slens[i];
+            if(gso) {
+                // Every segment but the last must be exactly the segment size
+                while((j < n_pending) && (j - i < GSO_MAX_SEGS)
+                      && (slens[j - 1] == slens[i]) && (slens[j] <= slens[i]) && (stxtimes[j] == stxtimes[i])
+                      && (bytes + slens[j] <= GSO_MAX_BYTES)
+                      && (0 == ::memcmp(&saddrs[j], &saddrs[i], sizeof(sockaddr_in)))) {
+                    bytes += slens[j];
+                    ++j;
+                }
+            }
+            for(size_t k = i; k < j; ++k) {
+                siovs[2 * k].iov_base = &hbuf[k * HEADER_SIZE];
+                siovs[2 * k].iov_len = HEADER_SIZE;
+                siovs[2 * k + 1].iov_base = spays[k] ? spays[k].data() + spay_offs[k] : nullptr;
+                siovs[2 * k + 1].iov_len = slens[k] - HEADER_SIZE;
+            }
+            msghdr& hdr = smsgs[n_msgs].msg_hdr;
+            ::memset(&smsgs[n_msgs], 0, sizeof(mmsghdr));
+            hdr.msg_iov = &siovs[2 * i];
+            hdr.msg_iovlen = 2 * (j - i);
+            hdr.msg_name = &saddrs[i];
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            bool has_txtime = txtime && (stxtimes[i] != 0);
+            if((j - i > 1) || has_txtime) {
+                hdr.msg_control = &sctrl[n_msgs * sctrl_words()];
+                hdr.msg_controllen = ((j - i > 1) ? CMSG_SPACE(sizeof(uint16_t)) : 0) + (has_txtime ? CMSG_SPACE(sizeof(uint64_t)) : 0);
+                ::memset(hdr.msg_control, 0, hdr.msg_controllen);
+                cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+                if(j - i > 1) {
+                    cm->cmsg_level = SOL_UDP;
+                    cm->cmsg_type = UDP_SEGMENT;
+                    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                    uint16_t gso_size = static_cast<uint16_t>(slens[i]);
+                    ::memmove(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+                    cm = CMSG_NXTHDR(&hdr, cm);
+                }
+                if(has_txtime) {
+                    // Segments of one GSO buffer share the departure time, runs only form over equal ones
+                    cm->cmsg_level = SOL_SOCKET;
+                    cm->cmsg_type = SCM_TXTIME;
+                    cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                    ::memmove(CMSG_DATA(cm), &stxtimes[i], sizeof(uint64_t));
+                }
+            }
+            sfirst[n_msgs] = i;
+            i = j;
+        }
+        sfirst[n_msgs] = n_pending;
+        return n_msgs;
+    }
+
+    void BatchIO::prepare_recv() {
+        PacketPool& pool = rpool();
+        ::memset(rmsgs.data(), 0, batch * sizeof(mmsghdr));
+        for(size_t i = 0; i < batch; ++i) {
+            // Reuse the slot buffer unless a received packet still references it
+            if(!rslots[i] || (rslots[i].use_count() > 1) || (rslots[i].capacity() != pool.get_block_size())) {
+                rslots[i] = pool.alloc();
+            }
+            riovs[i].iov_base = rslots[i].data();
+            riovs[i].iov_len = rslots[i].capacity();
+            rmsgs[i].msg_hdr.msg_iov = &riovs[i];
+            rmsgs[i].msg_hdr.msg_iovlen = 1;
+            rmsgs[i].msg_hdr.msg_name = &raddrs[i];
+            rmsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            if(gro) {
+                rmsgs[i].msg_hdr.msg_control = &rctrl[i * ctrl_words()];
+                rmsgs[i].msg_hdr.msg_controllen = ctrl_words() * sizeof(uint64_t);
+            }
+        }
+    }
+
+    void BatchIO::split_recv(int n) {
+        for(int i = 0; i < n; ++i) {
+            size_t len = rmsgs[i].msg_len;
+            size_t seg_size = len;
+            if(gro) {
+                // Coalesced datagrams carry their original size in a UDP_GRO cmsg
+                msghdr& hdr = rmsgs[i].msg_hdr;
+                for(cmsghdr* cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+                    if((cm->cmsg_level == SOL_UDP) && (cm->cmsg_type == UDP_GRO)) {
+                        int gso_size;
+                        ::memmove(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+                        if(gso_size > 0) {
+                            seg_size = gso_size;
+                        }
+                    }
+                }
+            }
+            // Segments of one super-datagram share its buffer
+            for(size_t off = 0; off < len; off += seg_size) {
+                Segment seg = {rslots[i], off, std::min(seg_size, len - off), raddrs[i]};
+                rsegs.push_back(seg);
+            }
+        }
+    }
+
+    bool BatchIO::is_socket_error(int err) {
+        // The socket itself is unusable; anything else concerns one destination or datagram, or passes
+        return (err == EBADF) || (err == ENOTSOCK) || (err == EFAULT);
+    }
+
+    void BatchIO::push(const RawPacket& pkg, const sockaddr_in& addr, uint64_t txtime_ns) {
+        if(n_pending == batch) {
+            flush();
+            if(n_pending == batch) {
+                // The kernel still has no room: dropped like a datagram lost on the way, the sender recovers it
+                return ;
+            }
+        }
+        pkg.encode_header(&hbuf[n_pending * HEADER_SIZE]);
+        spays[n_pending] = pkg.buf;
+        spay_offs[n_pending] = pkg.off;
+        slens[n_pending] = HEADER_SIZE + pkg.len;
+        saddrs[n_pending] = addr;
+        stxtimes[n_pending] = txtime_ns;
+        ++n_pending;
+    }
+
+    void BatchIO::flush() {
+        size_t first = 0;
+        while(first < n_pending) {
+            size_t n_msgs = prepare_send(first);
+            int n = ::sendmmsg(sockfd, smsgs.data(), n_msgs, 0);
+            if(-1 == n) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                if(gso && ((errno == EIO) || (errno == EINVAL))) {
+                    // Device can't segment (e.g. no checksum offload): fall back to one datagram each
+                    gso = false;
+                    continue;
+                }
+                if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS) || (errno == ENOMEM)) {
+                    // Socket buffer or device queue full: the rest goes next round, nothing is lost
+                    break;
+                }
+                if(is_socket_error(errno)) {
+                    throw std::runtime_error(jrReliableUDP::error_msg("Send error:"));
+                }
+                // Refused for its destination alone: unreachable, filtered, or larger than the device takes with DF
+                // set (a PMTU probe most likely). Dropped like a lost one, the connections to other peers go on.
+                first = sfirst[1];
+                continue;
+            }
+            first = sfirst[n];
+        }
+        // What the kernel had no room for moves to the front, in order
+        size_t kept = n_pending - first;
+        for(size_t i = 0; (first != 0) && (i < kept); ++i) {
+            ::memcpy(&hbuf[i * HEADER_SIZE], &hbuf[(first + i) * HEADER_SIZE], HEADER_SIZE);
+            spays[i] = std::move(spays[first + i]);
+            spay_offs[i] = spay_offs[first + i];
+            slens[i] = slens[first + i];
+            saddrs[i] = saddrs[first + i];
+            stxtimes[i] = stxtimes[first + i];
+        }
+        for(size_t i = kept; i < n_pending; ++i) {
+            spays[i] = PacketBuf();
+        }
+        n_pending = kept;
+    }
+
+    int BatchIO::recv() {
+        rsegs.clear();
+        prepare_recv();
+        // Whatever is queued, up to the batch; the socket never blocks
+        int n;
+        while(true) {
+            n = ::recvmmsg(sockfd, rmsgs.data(), batch, MSG_DONTWAIT, nullptr);
+            // An ICMP error an earlier datagram drew (ECONNREFUSED from a closed port, EHOSTUNREACH...) is reported
+            // once by the next call; it concerns that peer alone, whose connection times out if it persists
+            if((-1 == n) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != ENOMEM) && !is_socket_error(errno)) {
+                continue;
+            }
+            break;
+        }
+        if(-1 == n) {
+            if(is_socket_error(errno)) {
+                throw std::runtime_error(error_msg("Recv failed"));
+            }
+            // Nothing queued, or no memory to take it now
+            return -1;
+        }
+        split_recv(n);
+        return rsegs.size();
+    }
+
+}
@@ -0,0 +1,88 @@
+#ifndef IO_H
+#define IO_H
+
+#include "defs.hpp"
+#include <vector>
+#include <time.h>
+#include <netinet/udp.h>
+#include <linux/net_tstamp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT (103)
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO (104)
+#endif
+#ifndef SO_TXTIME
+#define SO_TXTIME (61)
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+namespace jrReliableUDP {
+    // Batched datagram I/O: queued packets leave in one sendmmsg, queued datagrams arrive in one recvmmsg.
+    // Payloads are never copied here: iovecs point into the pooled buffers the packets already live in.
+    class BatchIO {
+    private:
+        struct Segment {
+            PacketBuf buf;
+            size_t off;
+            size_t len;
+            sockaddr_in addr;
+        };
+
+        static const size_t GSO_MAX_SEGS = 64;
+        static const size_t GSO_MAX_BYTES = 65507;
+        int sockfd;
+        size_t batch;
+        size_t n_pending;   // Datagrams queued for sending
+        bool gso;   // UDP_SEGMENT: runs of equal-sized datagrams to one peer leave as one buffer
+        bool gro;   // UDP_GRO: the kernel may hand us coalesced super-datagrams
+        bool txtime;    // SO_TXTIME: datagrams may carry a departure time for the fq qdisc
+        std::vector<char> hbuf;     // Encoded headers of the queued datagrams
+        std::vector<PacketBuf> spays;   // Payloads of the queued datagrams, held until sent
+        std::vector<uint32_t> spay_offs;
+        std::vector<size_t> slens;
+        std::vector<uint64_t> stxtimes;     // CLOCK_MONOTONIC ns, 0 to leave at once
+        std::vector<size_t> sfirst;     // First datagram of each outgoing message
+        std::vector<sockaddr_in> saddrs;
+        std::vector<PacketBuf> rslots;  // Buffers recvmmsg writes into
+        std::vector<sockaddr_in> raddrs;
+        std::vector<iovec> siovs;   // Header and payload of each datagram
+        std::vector<iovec> riovs;
+        std::vector<mmsghdr> smsgs;
+        std::vector<mmsghdr> rmsgs;
+        std::vector<uint64_t> sctrl;    // cmsg buffers, uint64_t keeps them aligned
+        std::vector<uint64_t> rctrl;
+        std::vector<Segment> rsegs;
+
+    private:
+        static size_t ctrl_words() { return (CMSG_SPACE(sizeof(int)) + sizeof(uint64_t) - 1) / sizeof(uint64_t); }
+        static size_t sctrl_words() { return (CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t)) + sizeof(uint64_t) - 1) / sizeof(uint64_t); }
+        PacketPool& rpool() const { return gro ? PacketPool::jumbo() : PacketPool::frames(); }
+        size_t prepare_send(size_t first);
+        void prepare_recv();
+        void split_recv(int n);
+        static bool is_socket_error(int err);
+
+    public:
+        BatchIO(int sockfd, size_t batch = IO_BATCH);
+        size_t get_batch() const { return batch; }
+        void set_batch(size_t batch);
+        bool set_offload(bool on);  // Enable GSO/GRO where the kernel supports it, false if neither is
+        bool set_txtime(bool on);   // Enable SO_TXTIME on CLOCK_MONOTONIC, false if the kernel refuses it
+        bool has_txtime() const { return txtime; }
+        // Only the header is encoded, the payload is referenced. A non-zero txtime_ns holds the datagram
+        // in the fq qdisc until then; it is ignored unless set_txtime succeeded.
+        void push(const RawPacket& pkg, const sockaddr_in& addr, uint64_t txtime_ns = 0);
+        // Datagrams the kernel has no room for stay queued for the next flush; one its destination refuses is dropped
+        void flush();
+        bool has_pending() const { return n_pending != 0; }
+        int recv();     // Number of packets received, -1 when nothing is queued
+        const PacketBuf& buf(size_t i) const { return rsegs[i].buf; }
+        size_t offset(size_t i) const { return rsegs[i].off; }
+        size_t size(size_t i) const { return rsegs[i].len; }
+        const sockaddr_in& from(size_t i) const { return rsegs[i].addr; }
+    };
+}
+
+#endif
@@ -0,0 +1,322 @@
+#include "iothread.hpp"
+
+namespace jrReliableUDP {
+    Wakeup::Wakeup() : efd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), is_kicked(false) {
+        if(-1 == efd) {
+            throw std::runtime_error(error_msg("Eventfd create failed"));
+        }
+    }
+
+    Wakeup::~Wakeup() {
+        ::close(efd);
+    }
+
+    void Wakeup::kick() {
+        if(!is_kicked.exchange(true)) {
+            uint64_t one = 1;
+            ssize_t ret = ::write(efd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+
+    Channel::Channel(std::shared_ptr<Wakeup> wakeup, size_t ring_size)
+        : wakeup(wakeup), tx(ring_size), rx(ring_size), is_kicked(false), is_established(false), is_broken(false),
+          is_close_requested(false), is_finished(false), is_closing(false) {
+
+    }
+
+    void Channel::kick() {
+        // Once until the I/O thread has looked, however many messages come meanwhile
+        if(!is_kicked.exchange(true)) {
+            wakeup->kick();
+        }
+    }
+
+    void Channel::send(std::string data) {
+        tx_room.wait_until([this]() { return !tx.full() || is_finished.load(); });
+        if(is_finished.load()) {
+            throw std::runtime_error(error.empty() ? "Connection is not ESTABLISHED" : error);
+        }
+        tx.push(data);
+        kick();
+    }
+
+    std::string Channel::recv() {
+        std::string msg;
+        bool is_whole = true;
+        while(true) {
+            RawPacket pkg;
+            rx_ready.wait_until([this]() { return !rx.empty() || is_broken.load(); });
+            bool was_full = rx.full();
+            if(!rx.pop(pkg)) {
+                // Broken after its last push, so nothing is left behind
+                return "";
+            }
+            if(was_full) {
+                // The I/O thread stopped taking fragments for want of room
+                kick();
+            }
+            if(IS_SKIP(pkg.type)) {
+                is_whole = false;
+            } else if(is_whole) {
+                msg.append(pkg.payload(), pkg.len);
+            }
+            if(IS_MORE(pkg.type)) {
+                continue;
+            }
+            if(is_whole) {
+                return msg;
+            }
+            // Abandoned by the sender, wait for the next one
+            msg.clear();
+            is_whole = true;
+        }
+    }
+
+    void Channel::close() {
+        is_close_requested.store(true);
+        kick();
+        state_changed.wait_until([this]() { return is_finished.load(); });
+    }
+
+    IoThread::IoThread(size_t ring_size)
+        : reactor(std::make_shared<Reactor>()), ring_size(ring_size), wakeup(std::make_shared<Wakeup>()),
+          is_stopping(false), is_accepting(false), n_finished(0), accepted(ring_size) {
+        reactor->set_wakeup(wakeup->efd, [this]() { on_wakeup(); });
+        thread = std::thread([this]() { run(); });
+    }
+
+    IoThread::~IoThread() {
+        is_stopping.store(true);
+        wakeup->kick();
+        thread.join();
+    }
+
+    void IoThread::run() {
+        try {
+            reactor->run_until([this]() {
+                reap();
+                return is_stopping.load();
+            });
+        } catch(const std::runtime_error&) {
+        }
+        is_stopping.store(true);
+        {
+            // Their callers get a broken promise
+            std::lock_guard<std::mutex> lock(mtx);
+            commands.clear();
+        }
+        // Sockets are torn down here, on the loop's thread
+        for(auto& ch : channels) {
+            finish(*ch, "I/O thread stopped");
+            ch->sock.reset();
+        }
+        channels.clear();
+        pending.clear();
+        listener.reset();
+        accept_notifier.notify();
+    }
+
+    void IoThread::on_wakeup() {
+        // Cleared first: a kick from now on writes again, and its channel is seen below or next time
+        wakeup->is_kicked.store(false);
+        uint64_t n;
+        ssize_t ret = ::read(wakeup->efd, &n, sizeof(n));
+        (void)ret;
+        std::deque<std::packaged_task<void()>> due;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            due.swap(commands);
+        }
+        for(auto& task : due) {
+            task();
+        }
+        for(auto& ch : channels) {
+            if(ch->is_kicked.exchange(false)) {
+                pump(*ch);
+            }
+        }
+        accept_next();
+    }
+
+    void IoThread::call(std::function<void()> f) {
+        if(is_stopping.load()) {
+            throw std::runtime_error("I/O thread stopped");
+        }
+        std::packaged_task<void()> task(f);
+        std::future<void> done = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            commands.push_back(std::move(task));
+        }
+        wakeup->kick();
+        done.get();
+    }
+
+    void IoThread::serve(const std::shared_ptr<Channel>& ch) {
+        channels.push_back(ch);
+        // Pumped whenever its connection changes; the connection is the channel's, so only a weak handle on it
+        std::weak_ptr<Channel> w = ch;
+        ch->sock->conn->waiters.add([this, w]() {
+            std::shared_ptr<Channel> ch = w.lock();
+            if(!ch || !ch->sock) {
+                return true;
+            }
+            pump(*ch);
+            return ch->is_finished.load() && (ch->sock->conn->state() == CLOSED);
+        });
+        ch->is_established.store(true);
+        ch->state_changed.notify();
+        pump(*ch);
+    }
+
+    void IoThread::pump(Channel& ch) {
+        if(!ch.sock || ch.is_finished.load()) {
+            return ;
+        }
+        Connection& c = *ch.sock->conn;
+        bool is_sent = false;
+        bool is_rcvd = false;
+        // Outgoing, up to the send buffer as Socket::send_pkg; a connection past sending drops them like a failed send
+        bool can_send = (c.state() == ESTABLISHED) || (c.state() == CLOSE_WAIT);
+        std::string msg;
+        while((!can_send || (c.sender.backlog() <= c.options().snd_buf)) && ch.tx.pop(msg)) {
+            if(can_send) {
+                c.sender.send_DATA(0, msg.data(), msg.size(), 0, -1);
+            }
+            is_sent = true;
+        }
+        // Incoming fragments, their payload stays in the pooled buffer it arrived in
+        while(!ch.is_broken.load() && c.recver.readable(0) && !ch.rx.full()) {
+            RawPacket pkg = c.recver.recv_raw_packet(0);
+            ch.rx.push(pkg);
+            is_rcvd = true;
+        }
+        if(!c.recver.readable(0) && (c.state() != ESTABLISHED) && (c.state() != FIN_WAIT)) {
+            break_channel(ch, c.last_error());
+        }
+        if(ch.is_close_requested.load() && !ch.is_closing && ch.tx.empty()) {
+            ch.is_closing = true;
+            // Held by the channels until finished
+            Channel* p = &ch;
+            ch.sock->async_disconnect([this, p](const std::string& err) { finish(*p, err); });
+        }
+        if(is_sent) {
+            ch.tx_room.notify();
+        }
+        if(is_rcvd) {
+            ch.rx_ready.notify();
+        }
+    }
+
+    void IoThread::break_channel(Channel& ch, const std::string& msg) {
+        if(ch.is_broken.load()) {
+            return ;
+        }
+        ch.error = msg;
+        ch.is_broken.store(true);
+        ch.rx_ready.notify();
+    }
+
+    void IoThread::finish(Channel& ch, const std::string& msg) {
+        if(ch.is_finished.load()) {
+            return ;
+        }
+        break_channel(ch, msg);
+        ch.is_finished.store(true);
+        ch.tx_room.notify();
+        ch.state_changed.notify();
+        ++n_finished;
+    }
+
+    void IoThread::reap() {
+        if(n_finished == 0) {
+            return ;
+        }
+        // Outside the loop's callbacks; one dropped in TIME_WAIT is left to the reactor until it ends
+        for(size_t i = 0; i < channels.size(); ) {
+            Channel& ch = *channels[i];
+            if(ch.is_finished.load()) {
+                ch.sock.reset();
+                channels[i] = channels.back();
+                channels.pop_back();
+                --n_finished;
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    void IoThread::accept_next() {
+        while(!pending.empty() && accepted.push(pending.front())) {
+            pending.pop_front();
+            accept_notifier.notify();
+        }
+        if(!listener || is_accepting) {
+            return ;
+        }
+        is_accepting = true;
+        listener->async_accept([this](Socket s, const std::string& err) {
+            is_accepting = false;
+            if(err.empty()) {
+                std::shared_ptr<Channel> ch = std::make_shared<Channel>(wakeup, ring_size);
+                ch->sock.reset(new Socket(s));
+                serve(ch);
+                pending.push_back(ch);
+            }
+            accept_next();
+        });
+    }
+
+    std::shared_ptr<Channel> IoThread::connect(const std::string& peer_ip, uint16_t peer_port, std::function<void(Socket&)> f) {
+        std::shared_ptr<Channel> ch = std::make_shared<Channel>(wakeup, ring_size);
+        call([this, ch, peer_ip, peer_port, f]() {
+            try {
+                ch->sock.reset(new Socket(reactor));
+                if(f) {
+                    f(*ch->sock);
+                }
+                ch->sock->async_connect(peer_ip, peer_port, [this, ch](const std::string& err) {
+                    if(!err.empty()) {
+                        channels.push_back(ch);
+                        finish(*ch, err);
+                        return ;
+                    }
+                    serve(ch);
+                });
+            } catch(...) {
+                ch->sock.reset();
+                throw;
+            }
+        });
+        ch->state_changed.wait_until([&ch]() { return ch->is_established.load() || ch->is_finished.load(); });
+        if(!ch->is_established.load()) {
+            throw std::runtime_error(ch->error);
+        }
+        return ch;
+    }
+
+    void IoThread::listen(uint16_t port, std::function<void(Socket&)> f) {
+        call([this, port, f]() {
+            std::unique_ptr<Socket> s(new Socket(reactor));
+            if(f) {
+                f(*s);
+            }
+            s->bind(port);
+            s->listen();
+            listener = std::move(s);
+            accept_next();
+        });
+    }
+
+    std::shared_ptr<Channel> IoThread::accept() {
+        std::shared_ptr<Channel> ch;
+        accept_notifier.wait_until([this, &ch]() { return accepted.pop(ch) || is_stopping.load(); });
+        if(!ch) {
+            throw std::runtime_error("I/O thread stopped");
+        }
+        // Room for what was accepted meanwhile
+        wakeup->kick();
+        return ch;
+    }
+}
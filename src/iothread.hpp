@@ -0,0 +1,110 @@
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#include "jrudp.hpp"
+#include "spsc.hpp"
+#include <mutex>
+#include <thread>
+#include <future>
+
+namespace jrReliableUDP {
+    // An IoThread's eventfd, shared with its channels: one may outlive the thread, and kicking a loop that is gone
+    // only adds to a counter nobody reads
+    struct Wakeup {
+        int efd;
+        std::atomic<bool> is_kicked;    // efd was written and the loop hasn't looked yet
+
+        Wakeup();
+        Wakeup(const Wakeup&) = delete;
+        Wakeup& operator=(const Wakeup&) = delete;
+        ~Wakeup();
+        void kick();
+    };
+
+    // An application thread's end of a connection served by an IoThread. Messages go out and fragments come in
+    // through a pair of SPSC rings: one thread at a time may send on a channel and one receive, the same or another;
+    // close may be called from yet another one meanwhile.
+    // Messages are those of stream 0.
+    class Channel {
+        friend class IoThread;
+
+    private:
+        std::shared_ptr<Wakeup> wakeup;     // Of the IoThread serving it
+        std::unique_ptr<Socket> sock;   // I/O thread only
+        SpscRing<std::string> tx;   // Whole messages, the sender cuts them by the path MSS
+        SpscRing<RawPacket> rx;     // Fragments in order, their pooled payload handed over as is
+        Notifier rx_ready;  // Wakes the receiving thread
+        Notifier tx_room;   // Wakes the sending thread
+        Notifier state_changed;     // Wakes the connecting thread once established, the closing one once finished
+        std::atomic<bool> is_kicked;    // The I/O thread has been asked to look at this channel
+        std::atomic<bool> is_established;
+        std::atomic<bool> is_broken;    // Nothing more comes into rx, whatever is in it still counts
+        std::atomic<bool> is_close_requested;
+        std::atomic<bool> is_finished;  // Disconnected or failed
+        std::string error;  // Written before is_broken or is_finished, read after
+        bool is_closing;    // I/O thread only
+
+    private:
+        void kick();    // Have the I/O thread pump this channel
+
+    public:
+        Channel(std::shared_ptr<Wakeup> wakeup, size_t ring_size);
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+        // Blocks only while the ring is full, i.e. while the connection's send buffer is
+        void send(std::string data);
+        std::string recv();     // "" once closed, like Socket::recv_pkg
+        void close();   // Socket::disconnect on the I/O thread, waits for it
+        const std::string& last_error() const { return error; }    // Once recv returned "" or close returned
+    };
+
+    // Runs the protocol of its connections on a thread of its own, so their timers stay on time however long the
+    // application stalls, and sending never contends with it. Application threads exchange buffer handles with it
+    // over lock-free rings; wakeups both ways go through eventfds and are batched, a side that is busy anyway
+    // is never written to. connect, listen and accept are rare and serialised, the data path takes no lock.
+    class IoThread {
+        friend class Channel;
+
+    private:
+        std::shared_ptr<Reactor> reactor;
+        size_t ring_size;
+        std::shared_ptr<Wakeup> wakeup;     // Application threads wake the loop through it
+        std::atomic<bool> is_stopping;
+        bool is_accepting;  // An async_accept is out, I/O thread only
+        size_t n_finished;  // Finished channels not reaped yet, I/O thread only
+        std::mutex mtx;     // Guards commands only
+        std::deque<std::packaged_task<void()>> commands;
+        // I/O thread only
+        std::vector<std::shared_ptr<Channel>> channels;
+        std::unique_ptr<Socket> listener;
+        std::deque<std::shared_ptr<Channel>> pending;   // Accepted while the accepted ring was full
+        // Handshake done, to the accepting thread
+        SpscRing<std::shared_ptr<Channel>> accepted;
+        Notifier accept_notifier;
+        std::thread thread;
+
+    private:
+        void run();
+        void on_wakeup();
+        void call(std::function<void()> f);     // Run f on the I/O thread and wait, rethrows what it threw
+        void serve(const std::shared_ptr<Channel>& ch);
+        void pump(Channel& ch);
+        void break_channel(Channel& ch, const std::string& msg);
+        void finish(Channel& ch, const std::string& msg);
+        void reap();    // Drop channels that are finished and whose connection closed
+        void accept_next();
+
+    public:
+        explicit IoThread(size_t ring_size = HANDOFF_RING_SIZE);
+        IoThread(const IoThread&) = delete;
+        IoThread& operator=(const IoThread&) = delete;
+        ~IoThread();    // Stops the loop; channels still open are broken
+        // f configures a Socket before it opens, with the setters of Socket (set_congestion...)
+        std::shared_ptr<Channel> connect(const std::string& peer_ip, uint16_t peer_port,
+                                         std::function<void(Socket&)> f = nullptr);
+        void listen(uint16_t port, std::function<void(Socket&)> f = nullptr);
+        std::shared_ptr<Channel> accept();  // From one thread at a time
+    };
+}
+
+#endif
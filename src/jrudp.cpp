@@ -1,43 +1,35 @@
 #include "jrudp.hpp"
 
 jrReliableUDP::Socket::Socket()
-    : sockfd(::socket(AF_INET, SOCK_DGRAM, 0)), rto(RTO_INIT, -1, -1), cur_state(CLOSED),
-      sender(sockfd, addr, rto), recver(sockfd, addr, rto) {
-    if(-1 == sockfd) {
-        throw std::runtime_error(error_msg("Socket create failed"));
-    }
-}
+    : Socket(std::make_shared<Reactor>()) {
 
-jrReliableUDP::Socket::Socket(int fd, bool is_passive_end, sockaddr_in peer_addr, RTO rto,
-                              const Sender& s, const Recver& r, ConnectionState cs)
-    : sockfd(fd), is_passive_end(is_passive_end), addr(peer_addr), rto(rto), cur_state(cs),
-      sender(sockfd, addr, this->rto, s), recver(sockfd, addr, this->rto, r) {
-//    struct sigaction act;
-//    act.sa_handler = Socket::keep_alive_timeout;
-//    ::sigemptyset(&act.sa_mask);
-//    act.sa_flags = 0;
-//    ::sigaction(SIGALRM, &act, nullptr);
 }
 
-jrReliableUDP::Socket::~Socket() {
-    if(cur_state == LISTEN) {
-        ::close(sockfd);
-    }
+jrReliableUDP::Socket::Socket(std::shared_ptr<Reactor> reactor)
+    : reactor(reactor), endpoint(reactor->open()), port(0), is_passive_end(false) {
+
 }
 
-//void jrReliableUDP::Socket::keep_alive_timeout(int sig) {
-//    if(sig == SIGALRM) {
-//        // Start send keep alive probe packet
+jrReliableUDP::Socket::Socket(std::shared_ptr<Reactor> reactor, std::shared_ptr<Endpoint> endpoint, std::shared_ptr<Connection> conn)
+    : reactor(reactor), endpoint(endpoint), conn(conn), port(0), is_passive_end(conn->passive()), addr(conn->peer()) {
 
-//    }
-//}
+}
 
 void jrReliableUDP::Socket::disconnect_exception(std::string msg) {
-    ::close(sockfd);
-    cur_state = CLOSED;
+    if(conn) {
+        conn->fail(msg);
+    }
     throw std::runtime_error(msg);
 }
 
+template<typename Pred>
+void jrReliableUDP::Socket::wait_until(Pred pred) {
+    reactor->run_until([&]() { return pred() || !conn->last_error().empty(); });
+    if(!conn->last_error().empty()) {
+        throw std::runtime_error(conn->last_error());
+    }
+}
+
 void jrReliableUDP::Socket::set_local_address(uint16_t port) {
     ::memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
@@ -61,202 +53,556 @@ void jrReliableUDP::Socket::set_peer_address(std::string ip, uint16_t port) {
 
 void jrReliableUDP::Socket::bind(uint16_t port) {
     set_local_address(port);
-    if(-1 == ::bind(sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(sockaddr_in))) {
+    if(-1 == ::bind(endpoint->sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(sockaddr_in))) {
         disconnect_exception(error_msg("Bind failed"));
     }
     this->port = port;
 }
 
+void jrReliableUDP::Socket::open_connection() {
+    conn = endpoint->connect(addr);
+#ifdef DEBUG
+    std::cout << states[conn->state()] << ":";
+#endif
+    if(resumption.valid()) {
+        // Send SYN with the ticket(CLOSED->ESTABLISHED), data may follow it before the peer answers
+        conn->resume(resumption);
+    } else {
+        // Send SYN and ISN(CLOSED->SYN_SENT)
+        conn->open();
+    }
+}
+
 void jrReliableUDP::Socket::connect(std::string peer_ip, uint16_t peer_port) {
     is_passive_end = false;
-    while(true) {
+    // Set peer ip and port
+    set_peer_address(peer_ip, peer_port);
+    open_connection();
+    // Wait for the ACK and peer's SYN(SYN_SENT->ESTABLISHED)
+    wait_until([this]() { return conn->state() != SYN_SENT; });
+}
+
+void jrReliableUDP::Socket::listen(size_t n_shards, bool steer_by_peer) {
+    is_passive_end = true;
+    if(n_shards > 1) {
+        if(port == 0) {
+            throw std::runtime_error("Bind before listening on shards");
+        }
+        // Reopen the port as a SO_REUSEPORT group, shard 0 keeps this socket's reactor
+        ConnectionOptions options = endpoint->options;
+        bool is_syn_cookies = endpoint->is_syn_cookies;
+        bool is_zero_rtt = endpoint->is_zero_rtt;
+        uint64_t secret = endpoint->secret;
+        endpoint.reset();
+        set_local_address(port);
+        shards.clear();
+        for(size_t i = 0; i < n_shards; ++i) {
+            std::shared_ptr<Reactor> r = (i == 0) ? reactor : std::make_shared<Reactor>();
+            std::shared_ptr<Endpoint> ep = r->open();
+            ep->set_reuseport();
+            if(-1 == ::bind(ep->sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(sockaddr_in))) {
+                throw std::runtime_error(error_msg("Bind failed"));
+            }
+            ep->is_listening = true;
+            ep->is_syn_cookies = is_syn_cookies;
+            ep->is_zero_rtt = is_zero_rtt;
+            ep->secret = secret;
+            ep->options = options;
+            if(options.pacing == PACING_TXTIME) {
+                ep->io.set_txtime(true);
+            }
+            shards.emplace_back(r, ep);
+        }
+        if(steer_by_peer) {
+            shards[0].second->steer_by_peer(n_shards);
+        }
+        endpoint = shards[0].second;
+    }
+    endpoint->is_listening = true;
 #ifdef DEBUG
-    std::cout << states[cur_state] << ":";
+    std::cout << states[LISTEN] << ":";
 #endif
-        switch(cur_state) {
-        case CLOSED:
-            // Set peer ip and port
-            set_peer_address(peer_ip, peer_port);
-            // Send SYN and ISN(CLOSED->SYN_SENT)
-            sender.send_SYN();
-            cur_state = SYN_SENT;
-            break;
-        case SYN_SENT:
-            // wait for peer's SYN
-        {
-            // Received correct SYN(SYN_SENT->ESTABLISHED)
-            if(IS_SYN(recver.recv_raw_packet().type)) {
-                cur_state = ESTABLISHED;
-            }
+}
+
+jrReliableUDP::Socket jrReliableUDP::Socket::accept(size_t shard) {
+    if(shard >= shard_count()) {
+        throw std::runtime_error("No such shard");
+    }
+    std::shared_ptr<Reactor> r = shards.empty() ? reactor : shards[shard].first;
+    std::shared_ptr<Endpoint> ep = shards.empty() ? endpoint : shards[shard].second;
+    if(!ep->is_listening) {
+        throw std::runtime_error("Not listening");
+    }
+    // Handshakes run in the loop, any number at once
+    r->run_until([&ep]() { return !ep->accept_queue.empty(); });
+    std::shared_ptr<Connection> c = ep->accept_queue.front();
+    ep->accept_queue.pop_front();
+    return Socket(r, ep, c);
+}
+
+void jrReliableUDP::Socket::set_syn_cookies(bool on) {
+    endpoint->is_syn_cookies = on;
+    for(auto& s : shards) {
+        s.second->is_syn_cookies = on;
+    }
+}
+
+void jrReliableUDP::Socket::set_zero_rtt(bool on) {
+    endpoint->is_zero_rtt = on;
+    for(auto& s : shards) {
+        s.second->is_zero_rtt = on;
+    }
+}
+
+jrReliableUDP::ResumptionTicket jrReliableUDP::Socket::ticket() const {
+    if(!conn) {
+        throw std::runtime_error("Not connected");
+    }
+    return conn->ticket();
+}
+
+void jrReliableUDP::Socket::disconnect() {
+    if(!conn) {
+        return ;
+    }
+    if((conn->state() == ESTABLISHED) || (conn->state() == CLOSE_WAIT)) {
+        // Send all pkg in send buffer
+        wait_until([this]() { return conn->sender.is_all_acked(); });
+    }
+    if(is_passive_end) {
+        // Server waits peer's FIN(ESTABLISHED->CLOSE_WAIT)
+        wait_until([this]() { return conn->state() != ESTABLISHED; });
+    }
+    // Send FIN to peer and wait for its ACK and peer's FIN
+    conn->close();
+    wait_until([this]() { return (conn->state() == TIME_WAIT) || (conn->state() == CLOSED); });
+}
+
+template<typename Sink, typename Reset>
+int jrReliableUDP::Socket::take_message(Connection& c, uint8_t stream, Sink sink, Reset reset, bool& is_whole) {
+    // The window is far smaller than a large message, each fragment is taken as soon as it is in order
+    while(c.recver.readable(stream)) {
+        RawPacket pkg = c.recver.recv_raw_packet(stream);
+        if(IS_FIN(pkg.type)) {
+            // Closed in the middle of a message, what came of it is dropped
+            return -1;
+        }
+        if(IS_SKIP(pkg.type)) {
+            is_whole = false;
+        } else if(is_whole) {
+            sink(pkg.payload(), pkg.len);
+        }
+        if(IS_MORE(pkg.type)) {
+            continue;
+        }
+        if(is_whole) {
+            return 1;
         }
+        // Abandoned by the sender, wait for the next one
+        reset();
+        is_whole = true;
+    }
+    return ((c.state() != ESTABLISHED) && (c.state() != FIN_WAIT)) ? -1 : 0;
+}
+
+template<typename Sink, typename Reset>
+bool jrReliableUDP::Socket::recv_message(uint8_t stream, Sink sink, Reset reset) {
+    if(stream == DGRAM_STREAM) {
+        throw std::runtime_error("Datagrams are read with recv_datagram");
+    }
+    if(!conn) {
+        return false;
+    }
+    bool is_whole = true;
+    while(true) {
+        wait_until([this, stream]() {
+            return conn->recver.readable(stream) || ((conn->state() != ESTABLISHED) && (conn->state() != FIN_WAIT));
+        });
+        int ret = take_message(*conn, stream, sink, reset, is_whole);
+        if(ret < 0) {
+            return false;
+        }
+        if(ret > 0) {
             break;
-        case ESTABLISHED:
-            sender.set_WND();
-            recver.set_WND();
-            return ;
-        default:
-            return ;
         }
     }
+    reactor->flush();
+    return true;
 }
 
-void jrReliableUDP::Socket::listen() {
-    is_passive_end = true;
-#ifdef DEBUG
-    std::cout << states[cur_state] << ":";
-#endif
-    switch (cur_state) {
-    case CLOSED:
-        cur_state = LISTEN;
-        break;
-    case LISTEN:
-        break;
-    default:
-        break;
+std::string jrReliableUDP::Socket::recv_pkg(uint8_t stream) {
+    std::string ret;
+    if(!recv_message(stream, [&ret](const char* data, size_t n) { ret.append(data, n); }, [&ret]() { ret.clear(); })) {
+        return "";
     }
-#ifdef DEBUG
-    std::cout << states[cur_state] << ":";
-#endif
+    return ret;
 }
 
-jrReliableUDP::Socket jrReliableUDP::Socket::accept() {
-    bool stop = false;
-    while(!stop) {
-#ifdef DEBUG
-    std::cout << states[cur_state] << ":";
-#endif
-        switch(cur_state) {
-        case CLOSED:
-            throw std::runtime_error("Not listening");
-        case LISTEN:
-        {
-            // wait for peer's SYN(LISTEN->SYN_RCVD)
-            if(IS_SYN(recver.recv_raw_packet().type)) {
-                cur_state = SYN_RCVD;
-            } else {
-                // Received other type packet, send RST
-                sender.send_RST();
-                disconnect_exception("Connection invalid");
+size_t jrReliableUDP::Socket::recv_pkg(char* buf, size_t len, uint8_t stream) {
+    size_t n_total = 0;
+    if(!recv_message(stream, [&](const char* data, size_t n) {
+        if(n_total < len) {
+            ::memcpy(buf + n_total, data, std::min(n, len - n_total));
+        }
+        n_total += n;
+    }, [&n_total]() { n_total = 0; })) {
+        return 0;
+    }
+    return n_total;
+}
+
+void jrReliableUDP::Socket::send_pkg(const std::string& data, uint8_t stream) {
+    send_pkg(data.data(), data.size(), stream);
+}
+
+void jrReliableUDP::Socket::send_pkg(const char* data, size_t n, uint8_t stream) {
+    send_partial(data, n, 0, -1, stream);
+}
+
+void jrReliableUDP::Socket::send_partial(const std::string& data, int64_t lifetime_ms, int max_rtx, uint8_t stream) {
+    send_partial(data.data(), data.size(), lifetime_ms, max_rtx, stream);
+}
+
+void jrReliableUDP::Socket::send_partial(const char* data, size_t n, int64_t lifetime_ms, int max_rtx, uint8_t stream) {
+    if(stream == DGRAM_STREAM) {
+        throw std::runtime_error("Datagrams are sent with send_datagram");
+    }
+    if(!conn || ((conn->state() != ESTABLISHED) && (conn->state() != CLOSE_WAIT))) {
+        disconnect_exception("Connection is not ESTABLISHED");
+    }
+    conn->sender.send_DATA(stream, data, n, lifetime_ms, max_rtx);
+    // Block only while more than the send buffer is queued or in flight
+    wait_until([this]() { return conn->sender.backlog() <= conn->options().snd_buf; });
+}
+
+void jrReliableUDP::Socket::send_datagram(const std::string& data) {
+    send_datagram(data.data(), data.size());
+}
+
+void jrReliableUDP::Socket::send_datagram(const char* data, size_t n) {
+    if(!conn || ((conn->state() != ESTABLISHED) && (conn->state() != CLOSE_WAIT))) {
+        disconnect_exception("Connection is not ESTABLISHED");
+    }
+    if(n > conn->sender.get_mss()) {
+        throw std::runtime_error("Datagram larger than the path MSS");
+    }
+    // Sent once, a loss only costs the receiver the skip of its SEQ
+    conn->sender.send_DATA(DGRAM_STREAM, data, n, 0, 0);
+    wait_until([this]() { return conn->sender.backlog() <= conn->options().snd_buf; });
+}
+
+std::string jrReliableUDP::Socket::recv_datagram() {
+    if(!conn) {
+        return "";
+    }
+    wait_until([this]() {
+        return conn->recver.has_datagram() || ((conn->state() != ESTABLISHED) && (conn->state() != FIN_WAIT));
+    });
+    if(!conn->recver.has_datagram()) {
+        return "";
+    }
+    RawPacket pkg = conn->recver.recv_datagram();
+    reactor->flush();
+    return std::string(pkg.payload(), pkg.len);
+}
+
+size_t jrReliableUDP::Socket::write(const void* data, size_t n, uint8_t stream) {
+    iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = n;
+    return writev(&iov, 1, stream);
+}
+
+size_t jrReliableUDP::Socket::writev(const iovec* iov, int iovcnt, uint8_t stream) {
+    if(stream == DGRAM_STREAM) {
+        throw std::runtime_error("Datagrams are sent with send_datagram");
+    }
+    if(!conn || ((conn->state() != ESTABLISHED) && (conn->state() != CLOSE_WAIT))) {
+        disconnect_exception("Connection is not ESTABLISHED");
+    }
+    size_t n = 0;
+    for(int i = 0; i < iovcnt; ++i) {
+        conn->sender.write(stream, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        n += iov[i].iov_len;
+    }
+    wait_until([this]() { return conn->sender.backlog() <= conn->options().snd_buf; });
+    return n;
+}
+
+size_t jrReliableUDP::Socket::read(void* buf, size_t n, uint8_t stream) {
+    iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = n;
+    return readv(&iov, 1, stream);
+}
+
+size_t jrReliableUDP::Socket::readv(const iovec* iov, int iovcnt, uint8_t stream) {
+    if(stream == DGRAM_STREAM) {
+        throw std::runtime_error("Datagrams are read with recv_datagram");
+    }
+    size_t want = 0;
+    for(int i = 0; i < iovcnt; ++i) {
+        want += iov[i].iov_len;
+    }
+    if(!conn || (want == 0)) {
+        return 0;
+    }
+    size_t n = 0;
+    while(true) {
+        wait_until([this, stream]() {
+            return conn->recver.readable(stream) || ((conn->state() != ESTABLISHED) && (conn->state() != FIN_WAIT));
+        });
+        if(!conn->recver.readable(stream)) {
+            return 0;
+        }
+        for(int i = 0; i < iovcnt; ++i) {
+            size_t k = conn->recver.read(stream, static_cast<char*>(iov[i].iov_base), iov[i].iov_len);
+            n += k;
+            if(k < iov[i].iov_len) {
+                break;
             }
         }
-            break;
-        case SYN_RCVD:
-            // Send SYN and wait for peer's ACK
-            sender.send_SYN();
-            // SYN_RCVD->ESTABLISHED
-            cur_state = ESTABLISHED;
-            break;
-        case ESTABLISHED:
-            cur_state = LISTEN;
-            stop = true;
-            break;
-        default:
+        // Empty packets carry no bytes, only the FIN ends a read without any
+        if((n > 0) || conn->recver.rcvd_fin()) {
             break;
         }
     }
-    return Socket(::dup(sockfd), true, addr, rto, sender, recver, ESTABLISHED);
+    reactor->flush();
+    return n;
 }
 
-void jrReliableUDP::Socket::disconnect() {
-    if(cur_state == ESTABLISHED) {
-        // Send all pkg in send buffer
-        sender.send_all_in_buf();
+void jrReliableUDP::Socket::set_io_batch(size_t n) {
+    endpoint->io.set_batch(n);
+    for(auto& s : shards) {
+        s.second->io.set_batch(n);
     }
-    sender.reset_WND();
-    recver.reset_WND();
-    if(is_passive_end) {
-        // Server
-        while(true) {
-#ifdef DEBUG
-    std::cout << states[cur_state] << ":";
-#endif
-            switch(cur_state) {
-            case ESTABLISHED:
-                // ESTABLISHED->CLOSE_WAIT
-                cur_state = CLOSE_WAIT;
-                break;
-            case CLOSE_WAIT:
-            {
-                // wait peer's FIN
-                if(IS_FIN(recver.recv_raw_packet().type)) {
-                    // Recv the FIN, CLOSE_WAIT->LAST_ACK
-                    cur_state = LAST_ACK;
-                }
-            }
-                break;
-            case LAST_ACK:
-                // Send FIN to peer, wait peer's ACK, LAST_ACK->CLOSED
-                sender.send_FIN();
-                cur_state = CLOSED;
-                break;
-            case CLOSED:
-                ::close(sockfd);
-#ifdef DEBUG
-                std::cout << states[cur_state] << std::endl;
-#endif
-                return ;
-            default:
-                return ;
-            }
+}
+
+bool jrReliableUDP::Socket::set_offload(bool on) {
+    bool ret = endpoint->io.set_offload(on);
+    for(auto& s : shards) {
+        ret = s.second->io.set_offload(on) && ret;
+    }
+    return ret;
+}
+
+template<typename F>
+void jrReliableUDP::Socket::update_options(F f) {
+    if(conn) {
+        ConnectionOptions o = conn->options();
+        f(o);
+        conn->set_options(o);
+        return ;
+    }
+    f(endpoint->options);
+    for(auto& s : shards) {
+        f(s.second->options);
+    }
+}
+
+void jrReliableUDP::Socket::set_congestion(CongestionAlgorithm algo) {
+    update_options([algo](ConnectionOptions& o) { o.congestion = algo; });
+}
+
+jrReliableUDP::PacingMode jrReliableUDP::Socket::set_pacing(PacingMode mode) {
+    if(mode == PACING_TXTIME) {
+        bool ok = endpoint->io.set_txtime(true);
+        for(auto& s : shards) {
+            ok = s.second->io.set_txtime(true) && ok;
         }
-    } else {
-        // Client
-        while(true) {
-#ifdef DEBUG
-    std::cout << states[cur_state] << ":";
-#endif
-            switch(cur_state) {
-            case ESTABLISHED:
-                // ESTABLISHED->FIN_WAIT_1
-                cur_state = FIN_WAIT;
-                break;
-            case FIN_WAIT:
-                // Send FIN to peer(FIN_WAIT_1) and wait for peer's ACK(FIN_WAIT_1->FIN_WAIT_2)
-                sender.send_FIN();
-                // FIN_WAIT_2->TIME_WAIT
-                cur_state = TIME_WAIT;
-                break;
-            case TIME_WAIT:
-            {
-                // wait peer's FIN
-                RawPacket fin = recver.recv_raw_packet();
-                if(IS_FIN(fin.type)) {
-                    // TIME_WAIT->CLOSED
-                    cur_state = CLOSED;
-                }
-            }
-                break;
-            case CLOSED:
-                ::close(sockfd);
-#ifdef DEBUG
-                std::cout << states[cur_state] << std::endl;
-#endif
-                return ;
-            default:
-                return ;
-            }
+        if(!ok) {
+            mode = PACING_USER;
         }
     }
+    update_options([mode](ConnectionOptions& o) { o.pacing = mode; });
+    return mode;
 }
 
-std::string jrReliableUDP::Socket::recv_pkg() {
-    if(cur_state != ESTABLISHED) {
-        return "";
-    } else {
-        RawPacket pkg = recver.recv_raw_packet();
-        if(IS_FIN(pkg.type)) {
-            cur_state = CLOSE_WAIT;
+void jrReliableUDP::Socket::set_ack_policy(uint32_t every, int64_t delay_ms) {
+    update_options([every, delay_ms](ConnectionOptions& o) {
+        o.ack_every = every;
+        o.ack_delay_ms = delay_ms;
+    });
+}
+
+void jrReliableUDP::Socket::set_mss(uint16_t mss) {
+    mss = std::min<uint16_t>(std::max<uint16_t>(mss, 1), MAX_SIZE);
+    update_options([mss](ConnectionOptions& o) { o.mss = mss; });
+}
+
+void jrReliableUDP::Socket::set_keepalive(int64_t idle_ms, int64_t interval_ms, int probes) {
+    update_options([idle_ms, interval_ms, probes](ConnectionOptions& o) {
+        o.keepalive_ms = std::max<int64_t>(idle_ms, 0);
+        o.keepalive_interval_ms = std::max<int64_t>(interval_ms, 1);
+        o.keepalive_probes = std::max(probes, 1);
+    });
+}
+
+void jrReliableUDP::Socket::set_idle_timeout(int64_t ms) {
+    update_options([ms](ConnectionOptions& o) { o.idle_timeout_ms = std::max<int64_t>(ms, 0); });
+}
+
+uint16_t jrReliableUDP::Socket::path_mss() const {
+    return conn ? conn->sender.get_mss() : 0;
+}
+
+void jrReliableUDP::Socket::set_buffers(uint32_t snd_pkts, uint32_t rcv_pkts) {
+    update_options([snd_pkts, rcv_pkts](ConnectionOptions& o) {
+        o.snd_buf = std::max<uint32_t>(snd_pkts, 1);
+        o.rcv_buf = std::max<uint32_t>(rcv_pkts, 1);
+    });
+}
+
+int jrReliableUDP::Socket::set_kernel_buffers(int bytes) {
+    int ret = endpoint->set_kernel_buffers(bytes);
+    for(auto& s : shards) {
+        ret = std::min(ret, s.second->set_kernel_buffers(bytes));
+    }
+    return ret;
+}
+
+void jrReliableUDP::Socket::set_nodelay(bool on) {
+    update_options([on](ConnectionOptions& o) { o.nodelay = on; });
+}
+
+void jrReliableUDP::Socket::set_stream_priority(uint8_t stream, int priority) {
+    if(!conn) {
+        throw std::runtime_error("Not connected");
+    }
+    conn->sender.set_priority(stream, priority);
+}
+
+void jrReliableUDP::Socket::set_stream_buffer(uint32_t pkts) {
+    update_options([pkts](ConnectionOptions& o) { o.stream_buf = pkts; });
+}
+
+void jrReliableUDP::Socket::post_error(std::function<void(const std::string&)> handler, const std::string& msg) {
+    if(conn) {
+        conn->fail(msg);
+    }
+    reactor->post([handler, msg]() { handler(msg); });
+}
+
+void jrReliableUDP::Socket::async_connect(std::string peer_ip, uint16_t peer_port, Handler handler) {
+    is_passive_end = false;
+    set_peer_address(peer_ip, peer_port);
+    // Done with the ACK and peer's SYN(SYN_SENT->ESTABLISHED), or at once with a ticket
+    open_connection();
+    // The connection owns its waiters, a plain pointer keeps it from owning itself
+    Connection* c = conn.get();
+    conn->waiters.add([c, handler]() {
+        if(c->state() == SYN_SENT) {
+            return false;
         }
-        return std::string(pkg.data);
+        handler(c->last_error());
+        return true;
+    });
+    conn->wake();
+}
+
+void jrReliableUDP::Socket::async_accept(AcceptHandler handler, size_t shard) {
+    if(shard >= shard_count()) {
+        throw std::runtime_error("No such shard");
     }
+    std::shared_ptr<Reactor> r = shards.empty() ? reactor : shards[shard].first;
+    std::shared_ptr<Endpoint> ep = shards.empty() ? endpoint : shards[shard].second;
+    if(!ep->is_listening) {
+        throw std::runtime_error("Not listening");
+    }
+    // Handshakes run in the loop, any number at once; the endpoint owns its waiters, so only a weak handle on it
+    std::weak_ptr<Endpoint> w = ep;
+    ep->waiters.add([r, w, handler]() {
+        std::shared_ptr<Endpoint> ep = w.lock();
+        if(!ep || ep->accept_queue.empty()) {
+            return false;
+        }
+        std::shared_ptr<Connection> c = ep->accept_queue.front();
+        ep->accept_queue.pop_front();
+        handler(Socket(r, ep, c), "");
+        return true;
+    });
+    ep->wake();
 }
 
-void jrReliableUDP::Socket::send_pkg(const std::string& data) {
-    if(cur_state != ESTABLISHED) {
-        disconnect_exception("Connection is not ESTABLISHED");
+void jrReliableUDP::Socket::async_disconnect(Handler handler) {
+    if(!conn) {
+        reactor->post([handler]() { handler(""); });
+        return ;
+    }
+    Connection* c = conn.get();
+    bool is_passive = is_passive_end;
+    conn->waiters.add([c, is_passive, handler]() {
+        if(!c->last_error().empty()) {
+            handler(c->last_error());
+            return true;
+        }
+        if(((c->state() == ESTABLISHED) || (c->state() == CLOSE_WAIT)) && !c->sender.is_all_acked()) {
+            // Send all pkg in send buffer
+            return false;
+        }
+        if(is_passive && (c->state() == ESTABLISHED)) {
+            // Server waits peer's FIN(ESTABLISHED->CLOSE_WAIT)
+            return false;
+        }
+        // Send FIN to peer once, done with its ACK and peer's FIN
+        c->close();
+        if((c->state() != TIME_WAIT) && (c->state() != CLOSED)) {
+            return false;
+        }
+        handler("");
+        return true;
+    });
+    conn->wake();
+}
+
+void jrReliableUDP::Socket::async_send(const std::string& data, Handler handler, uint8_t stream) {
+    if(stream == DGRAM_STREAM) {
+        throw std::runtime_error("Datagrams are sent with send_datagram");
+    }
+    if(!conn || ((conn->state() != ESTABLISHED) && (conn->state() != CLOSE_WAIT))) {
+        post_error(handler, "Connection is not ESTABLISHED");
+        return ;
+    }
+    conn->sender.send_DATA(stream, data.data(), data.size(), 0, -1);
+    Connection* c = conn.get();
+    conn->waiters.add([c, handler]() {
+        if(!c->last_error().empty()) {
+            handler(c->last_error());
+            return true;
+        }
+        if(c->sender.backlog() > c->options().snd_buf) {
+            return false;
+        }
+        handler("");
+        return true;
+    });
+    conn->wake();
+}
+
+void jrReliableUDP::Socket::async_recv(RecvHandler handler, uint8_t stream) {
+    if(stream == DGRAM_STREAM) {
+        throw std::runtime_error("Datagrams are read with recv_datagram");
     }
-    if(data.size() > MAX_SIZE) {
-        throw std::runtime_error("Package too large");
+    if(!conn) {
+        reactor->post([handler]() { handler("", ""); });
+        return ;
     }
-    sender.send_DATA(data);
+    // Each op keeps what arrived of its message, later receives of the stream wait behind it
+    Connection* c = conn.get();
+    std::string msg;
+    bool is_whole = true;
+    conn->waiters.add([c, stream, handler, msg, is_whole]() mutable {
+        if(!c->last_error().empty()) {
+            handler("", c->last_error());
+            return true;
+        }
+        int ret = take_message(*c, stream, [&msg](const char* data, size_t n) { msg.append(data, n); },
+                               [&msg]() { msg.clear(); }, is_whole);
+        if(ret == 0) {
+            return false;
+        }
+        handler((ret > 0) ? msg : std::string(), "");
+        return true;
+    });
+    conn->wake();
 }
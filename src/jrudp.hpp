@@ -1,53 +1,160 @@
 #ifndef _JRUDP_H
 #define _JRUDP_H
 
-#include "recver.hpp"
-#include "sender.hpp"
+#include "reactor.hpp"
 #include <cstring>
 #include <stdexcept>
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 
 namespace jrReliableUDP {
+    // Blocking handle on a connection; while it waits, the reactor keeps every other
+    // connection of the same loop going. Copies share the same connection.
     class Socket {
-    private:
-        enum ConnectionState {CLOSED, SYN_SENT, LISTEN, SYN_RCVD, ESTABLISHED,
-                              FIN_WAIT, TIME_WAIT, CLOSE_WAIT, LAST_ACK};
+        friend class IoThread;
 
     private:
-        int sockfd;
+        std::shared_ptr<Reactor> reactor;
+        std::shared_ptr<Endpoint> endpoint;
+        std::shared_ptr<Connection> conn;   // Null until connected or accepted
+        std::vector<std::pair<std::shared_ptr<Reactor>, std::shared_ptr<Endpoint>>> shards;  // SO_REUSEPORT listeners, one loop each
         uint port;
         bool is_passive_end;
         sockaddr_in addr;
-        RTO rto;    // Timeout retransmit parameters
-        ConnectionState cur_state;
-        Sender sender;
-        Recver recver;
+        ResumptionTicket resumption;    // The next connect goes 0-RTT with it
 
     private:
-        Socket(int fd, bool is_passive_end, sockaddr_in addr, RTO rto,
-               const Sender& s, const Recver& r, ConnectionState cs);
-//        static void keep_alive_timeout(int sig);
+        Socket(std::shared_ptr<Reactor> reactor, std::shared_ptr<Endpoint> endpoint, std::shared_ptr<Connection> conn);
         [[noreturn]] void disconnect_exception(std::string msg);
+        template<typename Pred>
+        void wait_until(Pred pred);     // Run the loop until pred holds, throws if the connection breaks first
+        template<typename F>
+        void update_options(F f);   // Apply f to the connection's options, or to the endpoints' before connecting
+        // Feed each fragment of the stream's next message to sink, false if closed first. A message the sender
+        // abandoned in part is dropped: reset undoes what sink got of it, and the next message follows.
+        template<typename Sink, typename Reset>
+        bool recv_message(uint8_t stream, Sink sink, Reset reset);
+        // What has arrived of the message: 1 once it is complete, 0 while more has to come, -1 if closed first.
+        // is_whole carries over between calls of one message.
+        template<typename Sink, typename Reset>
+        static int take_message(Connection& c, uint8_t stream, Sink sink, Reset reset, bool& is_whole);
+        void post_error(std::function<void(const std::string&)> handler, const std::string& msg);
         void set_local_address(uint16_t port);
         void set_peer_address(std::string ip, uint16_t port);
+        void open_connection();     // With the ticket if there is one
 
     public:
         Socket();
+        explicit Socket(std::shared_ptr<Reactor> reactor);  // Serve this socket from an existing event loop
         Socket(const Socket&) = default;
         Socket(Socket&&) = default;
-        ~Socket();
+        ~Socket() = default;
         Socket& operator=(const Socket&) = default;
         Socket& operator=(Socket&&) = default;
+        std::shared_ptr<Reactor> get_reactor() const { return reactor; }
         void bind(uint16_t port);   // Bind a local port
         void connect(std::string peer_ip, uint16_t peer_port);  // Actively open, Send SYN and ISN to peer, CLOSED->SYN_SENT
-        void listen();  // Passively open, wait SYN and ISN,CLOSED->SYN_RCVD
-        Socket accept();   // send SYN and ACK to peer, SYN_RCVD->ESTABLISHED
-        void disconnect();  // ESTABLISHED->FIN_WAIT_1,FIN_WAIT_2,CLOSE_WAIT,LAST_ACK,TIME_WAIT->CLOSE
-        std::string recv_pkg();
-        void send_pkg(const std::string& data);
+        // Passively open, SYN from any new peer starts a connection in LISTEN. With n_shards > 1 the bound port
+        // becomes a SO_REUSEPORT group of n_shards sockets, each with its own reactor; the kernel hashes every peer
+        // to one of them, or the CBPF program does when steer_by_peer is set.
+        void listen(size_t n_shards = 1, bool steer_by_peer = false);
+        // Next connection whose handshake is done, SYN_RCVD->ESTABLISHED. Each shard must be accepted from and
+        // served by one thread of its own; its connections stay there for life and need no locking.
+        Socket accept(size_t shard = 0);
+        size_t shard_count() const { return std::max<size_t>(shards.size(), 1); }
+        // Answer every SYN with a cookie instead of a half-open connection, off by default. Nothing is kept until
+        // the peer's ACK echoes it, so a storm of SYNs costs no memory; the peer's options come back rounded down.
+        void set_syn_cookies(bool on);
+        // Hand every client a resumption ticket in our SYN, off by default. A SYN that brings one back less than
+        // TICKET_LIFETIME_MS later from the same address is accepted at once, with the data sent along with it.
+        // That data can be replayed by whoever captured it, as with TCP Fast Open: only for idempotent requests.
+        void set_zero_rtt(bool on);
+        // Client side: what the next connection to the same server resumes with, valid() if the server issued one.
+        // Take it late, just before disconnecting: the RTT and path MSS are the freshest then.
+        ResumptionTicket ticket() const;
+        // Before connect: send the SYN with this ticket and return at once, ESTABLISHED, so the first send_pkg
+        // leaves right behind it. Should the server turn it down, the handshake completes as usual and the data
+        // is delivered after it.
+        void set_ticket(const ResumptionTicket& t) { resumption = t; }
+        void disconnect();  // ESTABLISHED->FIN_WAIT,CLOSE_WAIT,LAST_ACK,TIME_WAIT->CLOSE
+        // Every call below takes a stream, 0 by default. Streams are independent ordered sequences sharing the
+        // connection: a loss on one never holds back delivery on another. Ids 0 to 254, none needs opening;
+        // DGRAM_STREAM is the datagram channel.
+        // Messages of any size: larger than MAX_SIZE they travel as fragments and come out whole, "" once closed
+        std::string recv_pkg(uint8_t stream = 0);
+        // Reassemble straight into buf; returns the message size, which exceeds len when the rest was dropped
+        size_t recv_pkg(char* buf, size_t len, uint8_t stream = 0);
+        void send_pkg(const std::string& data, uint8_t stream = 0);
+        void send_pkg(const char* data, size_t n, uint8_t stream = 0);
+        // Partially reliable: once lifetime_ms passed (0 for no limit), or a packet of the message was retransmitted
+        // max_rtx times (-1 for no limit), what is left of it is abandoned. The receiver skips its place instead of
+        // waiting, and recv_pkg drops the message whole rather than return a part of it.
+        void send_partial(const std::string& data, int64_t lifetime_ms, int max_rtx, uint8_t stream = 0);
+        void send_partial(const char* data, size_t n, int64_t lifetime_ms, int max_rtx, uint8_t stream = 0);
+        // Unreliable datagrams on the same connection, under its congestion control and receive window: never
+        // retransmitted, handed over in arrival order. One may carry up to path_mss() bytes.
+        void send_datagram(const std::string& data);
+        void send_datagram(const char* data, size_t n);
+        std::string recv_datagram();    // Waits for the next one, "" once closed
+        // Stream mode on the same connection, bytes without message bounds; don't mix it with packet mode on one
+        // stream and direction. Writes block like send_pkg and return n; short ones are coalesced into full packets
+        // unless set_nodelay. Reads wait for at least one byte and copy straight from the receive window, 0 once closed.
+        size_t write(const void* data, size_t n, uint8_t stream = 0);
+        size_t writev(const iovec* iov, int iovcnt, uint8_t stream = 0);
+        size_t read(void* buf, size_t n, uint8_t stream = 0);
+        size_t readv(const iovec* iov, int iovcnt, uint8_t stream = 0);
+        // Streams with a lower priority send first, equal ones take turns packet by packet; 0 for all by default,
+        // DGRAM_STREAM included. Only on a connected socket.
+        void set_stream_priority(uint8_t stream, int priority);
+        void set_io_batch(size_t n);   // Max datagrams moved by one sendmmsg/recvmmsg
+        bool set_offload(bool on);  // UDP GSO/GRO, false if the kernel supports neither
+        // Congestion controller of this connection; before connect or listen it applies to every connection
+        // started later, RENO by default. Switching starts the new controller from its initial window.
+        void set_congestion(CongestionAlgorithm algo);
+        // Spread each window over the round trip at the controller's pacing rate, off by default and scoped like
+        // set_congestion. PACING_TXTIME needs the fq qdisc on the outgoing device, the kernel ignores departure
+        // times elsewhere; it falls back to PACING_USER when SO_TXTIME is refused. Returns the mode in effect.
+        PacingMode set_pacing(PacingMode mode);
+        // Delayed ACKs, scoped like set_congestion: ACK every `every` in-order packets or after delay_ms (at most
+        // MAX_ACK_DELAY_MS), at once on gaps. (1, 0) ACKs every packet. Data we send always carries the ACK.
+        void set_ack_policy(uint32_t every, int64_t delay_ms);
+        // Largest payload per datagram, scoped like set_congestion and MAX_SIZE by default. Both ends announce theirs
+        // in the SYN; packets start at BASE_MSS and grow up to the smaller of the two as PMTU probes get through.
+        void set_mss(uint16_t mss);
+        void set_nodelay(bool on);  // Scoped like set_congestion, off by default
+        // Send and receive buffers in packets, scoped like set_congestion. The receive buffer is the window we
+        // advertise; above 65535 packets it is scaled, by the smallest shift that fits its size at the handshake.
+        void set_buffers(uint32_t snd_pkts, uint32_t rcv_pkts);
+        // Packets of one stream the receiver holds unread before that stream's sender waits, scoped like set_congestion.
+        // 0, the default, lets a single stream fill the receive buffer; smaller keeps a stream nobody reads from
+        // stalling the others.
+        void set_stream_buffer(uint32_t pkts);
+        int set_kernel_buffers(int bytes);  // SO_SNDBUF/SO_RCVBUF of the UDP socket(s), returns the size granted
+        // Keepalive, scoped like set_congestion and off by default (idle_ms 0): after idle_ms without a packet from
+        // the peer, and nothing of ours awaiting its ACK, probe it every interval_ms; after `probes` unanswered ones the
+        // connection fails. Runs on the reactor's timer wheel, one timer per connection and no signals.
+        void set_keepalive(int64_t idle_ms, int64_t interval_ms = KEEPALIVE_INTERVAL_MS, int probes = KEEPALIVE_PROBES);
+        // Abort a connection, RST to the peer, once no data went either way for ms; scoped like set_congestion,
+        // 0 (the default) never. Keepalive probes and their ACKs don't count, so it also reaps live but forgotten ones.
+        void set_idle_timeout(int64_t ms);
+        uint16_t path_mss() const;  // Payload size new packets are cut at, 0 before connecting
+
+        // Asynchronous calls return at once and never block. The handler runs later on the thread driving the
+        // reactor, from get_reactor()->run_once or while any socket of that loop blocks, never inside the call.
+        // error is "" on success; after one the connection is closed, as the blocking call would have thrown.
+        using Handler = std::function<void(const std::string& error)>;
+        using RecvHandler = std::function<void(const std::string& data, const std::string& error)>;
+        using AcceptHandler = std::function<void(Socket s, const std::string& error)>;
+        void async_connect(std::string peer_ip, uint16_t peer_port, Handler handler);
+        void async_accept(AcceptHandler handler, size_t shard = 0);
+        void async_disconnect(Handler handler);
+        // Done once the send buffer has room again, when send_pkg would have returned
+        void async_send(const std::string& data, Handler handler, uint8_t stream = 0);
+        // Receives of one stream complete in the order they were made; data is "" once closed
+        void async_recv(RecvHandler handler, uint8_t stream = 0);
     };
 }
 
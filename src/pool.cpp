@@ -0,0 +1,95 @@
+#include "pool.hpp"
+#include "defs.hpp"
+#include <new>
+
+namespace jrReliableUDP {
+    void PacketBuf::release() {
+        if(blk && (blk->refcnt.fetch_sub(1, std::memory_order_acq_rel) == 1)) {
+            blk->pool->release(blk);
+        }
+        blk = nullptr;
+    }
+
+    size_t PacketBuf::capacity() const {
+        return blk ? blk->pool->get_block_size() : 0;
+    }
+
+    PacketPool::PacketPool(size_t block_size, size_t slab_blocks)
+        : block_size(block_size), slab_blocks(std::max<size_t>(slab_blocks, 1)), free_list(nullptr), n_out(0), is_orphaned(false) {
+
+    }
+
+    PacketPool::~PacketPool() {
+        for(char* slab : slabs) {
+            delete[] slab;
+        }
+    }
+
+    PacketBuf PacketPool::alloc() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!free_list) {
+            // Carve a new slab into blocks, each a PacketBlock header followed by block_size bytes
+            size_t stride = (sizeof(PacketBlock) + block_size + alignof(PacketBlock) - 1) / alignof(PacketBlock) * alignof(PacketBlock);
+            char* slab = new char[stride * slab_blocks];
+            slabs.push_back(slab);
+            for(size_t i = 0; i < slab_blocks; ++i) {
+                PacketBlock* blk = reinterpret_cast<PacketBlock*>(slab + i * stride);
+                blk->pool = this;
+                new (&blk->refcnt) std::atomic<uint32_t>(0);
+                blk->next = free_list;
+                free_list = blk;
+            }
+        }
+        PacketBlock* blk = free_list;
+        free_list = blk->next;
+        ++n_out;
+        blk->refcnt.store(1, std::memory_order_relaxed);
+        return PacketBuf(blk);
+    }
+
+    void PacketPool::release(PacketBlock* blk) {
+        bool is_dead;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            blk->next = free_list;
+            free_list = blk;
+            --n_out;
+            is_dead = is_orphaned && (n_out == 0);
+        }
+        if(is_dead) {
+            delete this;
+        }
+    }
+
+    void PacketPool::orphan() {
+        bool is_dead;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            is_orphaned = true;
+            is_dead = (n_out == 0);
+        }
+        if(is_dead) {
+            delete this;
+        }
+    }
+
+    PacketPool& PacketPool::packets() {
+        static thread_local Holder holder{new PacketPool(HEADER_SIZE + BASE_MSS, 256)};
+        return *holder.pool;
+    }
+
+    PacketPool& PacketPool::frames() {
+        static thread_local Holder holder{new PacketPool(HEADER_SIZE + MAX_SIZE, 32)};
+        return *holder.pool;
+    }
+
+    PacketPool& PacketPool::fit(size_t n) {
+        PacketPool& pool = packets();
+        return (n <= pool.get_block_size()) ? pool : frames();
+    }
+
+    PacketPool& PacketPool::jumbo() {
+        static thread_local Holder holder{new PacketPool(65535, 8)};
+        return *holder.pool;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <atomic>
+#include <utility>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace jrReliableUDP {
+    class PacketPool;
+
+    struct PacketBlock {
+        PacketPool* pool;
+        std::atomic<uint32_t> refcnt;
+        PacketBlock* next;  // Free list link
+    };
+
+    // Reference-counted handle to a pooled buffer; the block goes back to its pool with the last handle
+    class PacketBuf {
+        friend class PacketPool;
+
+    private:
+        PacketBlock* blk;
+
+    private:
+        explicit PacketBuf(PacketBlock* blk) : blk(blk) {}
+        void release();
+
+    public:
+        PacketBuf() : blk(nullptr) {}
+        PacketBuf(const PacketBuf& buf) : blk(buf.blk) {
+            if(blk) {
+                blk->refcnt.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        PacketBuf(PacketBuf&& buf) : blk(buf.blk) { buf.blk = nullptr; }
+        ~PacketBuf() { release(); }
+        PacketBuf& operator=(PacketBuf buf) {
+            std::swap(blk, buf.blk);
+            return *this;
+        }
+        explicit operator bool() const { return blk != nullptr; }
+        char* data() const { return reinterpret_cast<char*>(blk + 1); }
+        size_t capacity() const;
+        uint32_t use_count() const { return blk ? blk->refcnt.load(std::memory_order_acquire) : 0; }
+    };
+
+    // Slab allocator of fixed-size packet buffers
+    class PacketPool {
+        friend class PacketBuf;
+
+    private:
+        // Owns a thread's pool; once the thread exits the pool frees itself with its last outstanding block
+        struct Holder {
+            PacketPool* pool;
+            ~Holder() { pool->orphan(); }
+        };
+
+        size_t block_size;
+        size_t slab_blocks;     // Blocks carved out of one slab
+        std::mutex mtx;     // Uncontended unless a buffer is released by another thread
+        PacketBlock* free_list;
+        std::vector<char*> slabs;
+        size_t n_out;   // Blocks handed out and not released yet
+        bool is_orphaned;
+
+    private:
+        void release(PacketBlock* blk);
+        void orphan();
+
+    public:
+        PacketPool(size_t block_size, size_t slab_blocks);
+        PacketPool(const PacketPool&) = delete;
+        PacketPool& operator=(const PacketPool&) = delete;
+        ~PacketPool();
+        size_t get_block_size() const { return block_size; }
+        PacketBuf alloc();
+        // Per thread, so shards on different cores never share a free list
+        static PacketPool& packets();   // One packet: header and up to BASE_MSS payload, what most packets fit in
+        static PacketPool& frames();    // One packet: header and up to MAX_SIZE payload
+        static PacketPool& jumbo();     // GRO super-datagrams
+        static PacketPool& fit(size_t n);   // The smaller of packets() and frames() that holds n bytes
+    };
+}
+
+#endif
@@ -0,0 +1,410 @@
+#include "reactor.hpp"
+
+namespace jrReliableUDP {
+    Endpoint::Endpoint(Reactor& reactor, int sockfd)
+        : reactor(reactor), sockfd(sockfd), io(sockfd), is_listening(false), is_syn_cookies(false), is_zero_rtt(false) {
+        std::random_device rd;
+        secret = (static_cast<uint64_t>(rd()) << 32) | rd();
+        // DF on everything and no kernel PMTU cache in the way: each connection finds its own by probing
+        int pmtu = IP_PMTUDISC_PROBE;
+        if(-1 == ::setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu, sizeof(pmtu))) {
+            throw std::runtime_error(error_msg("Set IP_MTU_DISCOVER failed"));
+        }
+        // A full window arrives in a burst, the kernel's default buffer is far smaller
+        set_kernel_buffers(SOCK_BUF_SIZE);
+        reactor.add(this);
+    }
+
+    Endpoint::~Endpoint() {
+        try {
+            // The last ACK may still be queued
+            io.flush();
+        } catch(const std::runtime_error&) {
+        }
+        reactor.remove(this);
+        ::close(sockfd);
+    }
+
+    uint64_t Endpoint::peer_key(const sockaddr_in& addr) {
+        return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+    }
+
+    std::shared_ptr<Connection> Endpoint::connect(const sockaddr_in& peer) {
+        auto it = conns.find(peer_key(peer));
+        if((it != conns.end()) && !it->second->is_finished()) {
+            throw std::runtime_error("Already connected to this peer");
+        }
+        return add(peer, false);
+    }
+
+    std::shared_ptr<Connection> Endpoint::add(const sockaddr_in& peer, bool is_passive_end) {
+        uint64_t key = peer_key(peer);
+        std::shared_ptr<Connection> conn = std::make_shared<Connection>(io, reactor.wheel, peer, is_passive_end);
+        conn->set_close_handler([this, key]() { closed.push_back(key); });
+        std::weak_ptr<Connection> w = conn;
+        Reactor* r = &reactor;
+        conn->set_wake_handler([r, w]() {
+            r->post([w]() {
+                // Gone if the user dropped every handle meanwhile
+                if(std::shared_ptr<Connection> c = w.lock()) {
+                    c->waiters.poll();
+                }
+            });
+        });
+        conn->set_options(options);
+        if(is_passive_end && is_zero_rtt) {
+            conn->issue_ticket(issue_ticket(peer));
+        }
+        conns[key] = conn;
+        return conn;
+    }
+
+    void Endpoint::set_reuseport() {
+        int on = 1;
+        if(-1 == ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+            throw std::runtime_error(error_msg("Set SO_REUSEPORT failed"));
+        }
+    }
+
+    int Endpoint::set_kernel_buffers(int bytes) {
+        // The FORCE options ignore the sysctl limits but need CAP_NET_ADMIN, the plain ones are capped silently
+        if(-1 == ::setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes))) {
+            ::setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+        }
+        if(-1 == ::setsockopt(sockfd, SOL_SOCKET, SO_SNDBUFFORCE, &bytes, sizeof(bytes))) {
+            ::setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+        }
+        int granted = 0;
+        socklen_t len = sizeof(granted);
+        ::getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &granted, &len);
+        // The kernel reports twice what it was asked for, the other half is its bookkeeping
+        return granted / 2;
+    }
+
+    void Endpoint::steer_by_peer(size_t n_shards) {
+        // The program sees the UDP payload, the peer is read through the IPv4 header (assumed without options).
+        // Returns the index of the socket in bind order; the kernel falls back to its own hash if it is out of range.
+        sock_filter code[] = {
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_NET_OFF + 12)),  // A = source address
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_LD | BPF_H | BPF_ABS, static_cast<uint32_t>(SKF_NET_OFF + 20)),  // A = source port
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+            BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1),   // Spread sequential ports and addresses
+            BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+            BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(n_shards)),
+            BPF_STMT(BPF_RET | BPF_A, 0),
+        };
+        sock_fprog prog;
+        prog.len = sizeof(code) / sizeof(code[0]);
+        prog.filter = code;
+        if(-1 == ::setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+            throw std::runtime_error(error_msg("Attach reuseport CBPF failed"));
+        }
+    }
+
+    void Endpoint::on_packet(const RawPacket& pkg, const sockaddr_in& from) {
+        auto it = conns.find(peer_key(from));
+        std::shared_ptr<Connection> conn;
+        if(it != conns.end()) {
+            conn = it->second;
+        } else if(is_listening && IS_SYN(pkg.type)) {
+            // One of our tickets: the peer skips the wait for our SYN's ACK, the data it sent along is taken at once
+            bool is_resumed = is_zero_rtt && !IS_ACK(pkg.type) && check_ticket(from, SynOptions(pkg).ticket);
+            if(!is_resumed && is_syn_cookies && !IS_ACK(pkg.type) && answer_with_cookie(pkg, from)) {
+                return ;
+            }
+            // New peer, its connection starts in LISTEN
+            conn = add(from, true);
+            if(is_resumed) {
+                conn->accept_resumption(pkg.win_size);
+            }
+        } else if(is_listening && is_syn_cookies && IS_ACK(pkg.type) && !IS_FIN(pkg.type) && !IS_RST(pkg.type)
+                  && (conn = restore_from_cookie(pkg, from))) {
+            // The handshake completed, the packet may already carry data
+        } else {
+            if(is_listening && IS_DATA(pkg.type) && IS_ACK(pkg.type)) {
+                // Data for no connection, send RST. Without an ACK it was sent with a SYN, ahead of it or answered
+                // with a cookie: dropped, the peer sends it again once connected
+                io.push(RawPacket(0, 0, 0, RST), from);
+            }
+            return ;
+        }
+        ConnectionState old_state = conn->state();
+        conn->on_packet(pkg);
+        if(((old_state == LISTEN) || (old_state == SYN_RCVD)) && (conn->state() != LISTEN) && (conn->state() != SYN_RCVD)
+           && (conn->state() != CLOSED)) {
+            accept_queue.push_back(conn);
+            wake();
+        }
+    }
+
+    // Cookie: slot 2 bits, MSS index 3, window scale 4 (15 for none), log2 of the stream credit 5, MAC 18.
+    // The peer's options are rounded down, so it never gets more than it announced.
+    static const uint16_t COOKIE_MSS[] = {256, 536, 1024, BASE_MSS, 1500 - IP_UDP_SIZE - HEADER_SIZE, 4096, 8192, MAX_SIZE};
+    static const int COOKIE_MAC_BITS = 18;
+
+    // splitmix64 of a keyed input: not cryptographic, but without the secret its output can only be guessed
+    static uint64_t keyed_mix(uint64_t key, uint64_t a, uint64_t b) {
+        uint64_t x = a ^ key;
+        x += b * 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    uint32_t Endpoint::cookie_mac(const sockaddr_in& peer, uint32_t slot, uint32_t fields) const {
+        // A forged cookie is a 1 in 2^18 guess, and it expires with its slot
+        uint64_t x = keyed_mix(secret, peer_key(peer), (static_cast<uint64_t>(slot) << 32) | fields);
+        return static_cast<uint32_t>(x) & ((1u << COOKIE_MAC_BITS) - 1);
+    }
+
+    // Ticket: issue time in seconds 32 bits, MAC 32. Keyed apart from cookies, so neither passes for the other.
+    static uint32_t ticket_mac(uint64_t secret, const sockaddr_in& peer, uint32_t issued) {
+        return static_cast<uint32_t>(keyed_mix(~secret, peer.sin_addr.s_addr, issued));
+    }
+
+    uint64_t Endpoint::issue_ticket(const sockaddr_in& peer) const {
+        uint32_t issued = static_cast<uint32_t>(get_now_ms() / 1000) + 1;
+        return (static_cast<uint64_t>(issued) << 32) | ticket_mac(secret, peer, issued);
+    }
+
+    bool Endpoint::check_ticket(const sockaddr_in& peer, uint64_t ticket) const {
+        uint32_t issued = static_cast<uint32_t>(ticket >> 32);
+        uint32_t now = static_cast<uint32_t>(get_now_ms() / 1000) + 1;
+        if((issued == 0) || (issued > now) || (now - issued > TICKET_LIFETIME_MS / 1000)) {
+            return false;
+        }
+        return static_cast<uint32_t>(ticket) == ticket_mac(secret, peer, issued);
+    }
+
+    uint32_t Endpoint::cookie_wnd() const {
+        // What Recver::set_buffer would keep of options.rcv_buf
+        uint32_t n = std::max<uint32_t>(options.rcv_buf, 1);
+        return std::min<uint32_t>(n, static_cast<uint32_t>(UINT16_MAX) << Recver::wscale_for(n));
+    }
+
+    bool Endpoint::answer_with_cookie(const RawPacket& syn, const sockaddr_in& from) {
+        SynOptions peer(syn);
+        int mss_idx = 7;
+        while((mss_idx >= 0) && (COOKIE_MSS[mss_idx] > peer.mss)) {
+            --mss_idx;
+        }
+        if(mss_idx < 0) {
+            // Too small to round down, rare enough to be worth a connection
+            return false;
+        }
+        uint32_t credit_log = 0;
+        while((credit_log < 31) && ((2u << credit_log) <= peer.stream_buf)) {
+            ++credit_log;
+        }
+        uint32_t fields = (static_cast<uint32_t>(mss_idx) << 9) | ((peer.has_wscale ? peer.wscale : 15u) << 5) | credit_log;
+        uint32_t slot = static_cast<uint32_t>(get_now_ms() / COOKIE_SLOT_MS);
+        uint32_t cookie = ((slot & 3) << 30) | (fields << COOKIE_MAC_BITS) | cookie_mac(from, slot, fields);
+        // Our SYN as a connection would send it, with the ACK: the cookie is its SEQ. Sent once, nothing is kept;
+        // if it is lost the peer repeats its SYN.
+        uint32_t wnd = cookie_wnd();
+        SynOptions ours;
+        ours.mss = options.mss;
+        ours.has_wscale = true;
+        ours.wscale = Recver::wscale_for(wnd);
+        ours.stream_buf = options.stream_buf ? std::min(options.stream_buf, wnd) : wnd;
+        ours.ticket = is_zero_rtt ? issue_ticket(from) : 0;
+        char opts[SYN_OPTIONS_SIZE];
+        size_t n = ours.encode(opts);
+        RawPacket reply(cookie, syn.seq_num + 1, static_cast<uint16_t>(std::min<uint32_t>(wnd, UINT16_MAX)), SYN | ACK, opts, n);
+        reply.ts_ecr = syn.ts_val;
+        io.push(reply, from);
+        return true;
+    }
+
+    std::shared_ptr<Connection> Endpoint::restore_from_cookie(const RawPacket& pkg, const sockaddr_in& from) {
+        uint32_t cookie = pkg.ack_num - 1;
+        uint32_t slot = static_cast<uint32_t>(get_now_ms() / COOKIE_SLOT_MS);
+        uint32_t age = (slot - (cookie >> 30)) & 3;
+        uint32_t fields = (cookie >> COOKIE_MAC_BITS) & 0xFFF;
+        if((age > 1) || ((cookie & ((1u << COOKIE_MAC_BITS) - 1)) != cookie_mac(from, slot - age, fields))) {
+            return nullptr;
+        }
+        SynOptions peer;
+        peer.mss = COOKIE_MSS[fields >> 9];
+        peer.has_wscale = (((fields >> 5) & 15) != 15);
+        peer.wscale = peer.has_wscale ? static_cast<uint8_t>((fields >> 5) & 15) : 0;
+        peer.stream_buf = 1u << (fields & 31);
+        std::shared_ptr<Connection> conn = add(from, true);
+        // A pure ACK carries the SEQ after the peer's ISN, so does its first data packet. Should that be lost
+        // along with the ACK, a later one sets the ISN too high, as with TCP's cookies.
+        conn->restore(cookie, pkg.seq_num - 1, peer, static_cast<uint16_t>(std::min<uint32_t>(cookie_wnd(), UINT16_MAX)));
+        accept_queue.push_back(conn);
+        wake();
+        return conn;
+    }
+
+    void Endpoint::on_readable() {
+        RawPacket pkg;
+        int n = io.recv();
+        // Handle the whole batch, its ACKs leave together when the loop flushes
+        for(int i = 0; i < n; ++i) {
+            if(pkg.decode(io.buf(i), io.offset(i), io.size(i))) {
+                on_packet(pkg, io.from(i));
+            }
+        }
+    }
+
+    void Endpoint::reap() {
+        for(uint64_t key : closed) {
+            auto it = conns.find(key);
+            // The peer may have been connected again since
+            if((it != conns.end()) && it->second->is_finished()) {
+                conns.erase(it);
+            }
+        }
+        closed.clear();
+    }
+
+    void Endpoint::wake() {
+        if(!waiters.post()) {
+            return ;
+        }
+        // By socket, the endpoint may be closed before the round ends
+        Reactor* r = &reactor;
+        int fd = sockfd;
+        reactor.post([r, fd]() {
+            auto it = r->endpoints.find(fd);
+            if(it != r->endpoints.end()) {
+                it->second->waiters.poll();
+            }
+        });
+    }
+
+    bool Endpoint::is_lingering() const {
+        for(auto& c : conns) {
+            if(c.second->state() == TIME_WAIT) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Reactor::Reactor() : epfd(::epoll_create1(EPOLL_CLOEXEC)), wheel(get_now_ms()) {
+        if(-1 == epfd) {
+            throw std::runtime_error(error_msg("Epoll create failed"));
+        }
+    }
+
+    Reactor::~Reactor() {
+        // Their TIME_WAIT is cut short, nobody runs the loop any more
+        lingering.clear();
+        ::close(epfd);
+    }
+
+    void Reactor::add(Endpoint* ep) {
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = ep;
+        if(-1 == ::epoll_ctl(epfd, EPOLL_CTL_ADD, ep->sockfd, &ev)) {
+            throw std::runtime_error(error_msg("Epoll add failed"));
+        }
+        endpoints[ep->sockfd] = ep;
+    }
+
+    void Reactor::remove(Endpoint* ep) {
+        ::epoll_ctl(epfd, EPOLL_CTL_DEL, ep->sockfd, nullptr);
+        endpoints.erase(ep->sockfd);
+    }
+
+    void Reactor::set_wakeup(int fd, std::function<void()> handler) {
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;  // Not an endpoint
+        if(-1 == ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+            throw std::runtime_error(error_msg("Epoll add failed"));
+        }
+        wakeup_handler = handler;
+    }
+
+    std::shared_ptr<Endpoint> Reactor::open() {
+        // Non-blocking: a full socket buffer defers the rest of a batch to the next round instead of stalling the loop
+        int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(-1 == fd) {
+            throw std::runtime_error(error_msg("Socket create failed"));
+        }
+        Endpoint* ep;
+        try {
+            ep = new Endpoint(*this, fd);
+        } catch(...) {
+            ::close(fd);
+            throw;
+        }
+        // The last handle going hands it back to the loop, which may have to keep it a while
+        return std::shared_ptr<Endpoint>(ep, [this](Endpoint* e) { release(e); });
+    }
+
+    void Reactor::release(Endpoint* ep) {
+        if(ep->is_lingering()) {
+            // The peer may still retransmit its FIN, keep answering it until TIME_WAIT ends
+            lingering.emplace_back(ep);
+        } else {
+            delete ep;
+        }
+    }
+
+    void Reactor::flush() {
+        for(auto& e : endpoints) {
+            e.second->io.flush();
+        }
+    }
+
+    bool Reactor::is_backlogged() const {
+        for(auto& e : endpoints) {
+            if(e.second->io.has_pending()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Reactor::run_once(int timeout_ms) {
+        // Sleep until a datagram arrives or the earliest timer is due
+        int64_t t = wheel.next_deadline();
+        if(!posted.empty()) {
+            timeout_ms = 0;
+        } else if(is_backlogged()) {
+            // Datagrams the kernel had no room for: try again on the next tick
+            timeout_ms = ((timeout_ms < 0) || (timeout_ms > 1)) ? 1 : timeout_ms;
+        } else if(t != 0) {
+            int64_t wait = std::max<int64_t>(t - get_now_ms(), 0);
+            if((timeout_ms < 0) || (wait < timeout_ms)) {
+                timeout_ms = static_cast<int>(std::min<int64_t>(wait, INT32_MAX));
+            }
+        }
+        epoll_event events[MAX_EVENTS];
+        int n = ::epoll_wait(epfd, events, MAX_EVENTS, timeout_ms);
+        if(-1 == n) {
+            if(errno == EINTR) {
+                return ;
+            }
+            throw std::runtime_error(error_msg("Epoll wait failed"));
+        }
+        for(int i = 0; i < n; ++i) {
+            if(events[i].data.ptr) {
+                static_cast<Endpoint*>(events[i].data.ptr)->on_readable();
+            } else {
+                wakeup_handler();
+            }
+        }
+        wheel.advance(get_now_ms());
+        // Completion handlers; whatever they post waits for the next round
+        std::vector<std::function<void()>> due;
+        due.swap(posted);
+        for(auto& f : due) {
+            f();
+        }
+        for(auto& e : endpoints) {
+            e.second->reap();
+        }
+        lingering.erase(std::remove_if(lingering.begin(), lingering.end(),
+                                       [](const std::unique_ptr<Endpoint>& ep) { return !ep->is_lingering(); }),
+                        lingering.end());
+        flush();
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "connection.hpp"
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <random>
+#include <unordered_map>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <linux/filter.h>
+
+namespace jrReliableUDP {
+    class Reactor;
+
+    // One UDP socket and every connection on it, told apart by peer address
+    class Endpoint {
+    private:
+        Reactor& reactor;
+        std::unordered_map<uint64_t, std::shared_ptr<Connection>> conns;
+        std::vector<uint64_t> closed;   // Peers whose connection closed since the last reap
+
+    public:
+        int sockfd;
+        BatchIO io; // Shared by every connection on the socket
+        bool is_listening;
+        bool is_syn_cookies;    // Answer SYNs statelessly, a connection only exists once the peer echoes the cookie
+        bool is_zero_rtt;   // Hand out resumption tickets, and take data with the SYNs that bring them back
+        uint64_t secret;    // Keys cookies and tickets; the shards of one port share it, a ticket works on any of them
+        ConnectionOptions options;  // For every connection started from now on
+        std::deque<std::shared_ptr<Connection>> accept_queue;   // Handshake done, not accepted yet
+        Waiters waiters;    // Asynchronous accepts
+
+    private:
+        static uint64_t peer_key(const sockaddr_in& addr);
+        void on_packet(const RawPacket& pkg, const sockaddr_in& from);
+        std::shared_ptr<Connection> add(const sockaddr_in& peer, bool is_passive_end);
+        uint32_t cookie_mac(const sockaddr_in& peer, uint32_t slot, uint32_t fields) const;
+        uint32_t cookie_wnd() const;    // Window our cookie SYN+ACK offers
+        bool answer_with_cookie(const RawPacket& syn, const sockaddr_in& from);     // false if it takes a connection
+        uint64_t issue_ticket(const sockaddr_in& peer) const;   // Bound to the peer's address, not its port
+        bool check_ticket(const sockaddr_in& peer, uint64_t ticket) const;
+        std::shared_ptr<Connection> restore_from_cookie(const RawPacket& pkg, const sockaddr_in& from);
+
+    public:
+        Endpoint(Reactor& reactor, int sockfd);
+        Endpoint(const Endpoint&) = delete;
+        Endpoint& operator=(const Endpoint&) = delete;
+        ~Endpoint();
+        std::shared_ptr<Connection> connect(const sockaddr_in& peer);   // Active connection, not opened yet
+        void set_reuseport();   // Before bind: join the SO_REUSEPORT group of the port
+        int set_kernel_buffers(int bytes);  // SO_SNDBUF/SO_RCVBUF, past [rw]mem_max where privileged; returns the receive size granted
+        void steer_by_peer(size_t n_shards);    // Group-wide CBPF: a peer always lands on shard hash(addr, port) % n
+        size_t size() const { return conns.size(); }
+        bool is_lingering() const;  // Some connection is still in TIME_WAIT
+        void on_readable();
+        void reap();    // Drop closed connections, outside of any of their callbacks
+        void wake();    // Have the waiters checked
+    };
+
+    // Event loop over any number of endpoints. Not thread safe: every socket sharing
+    // a reactor must be used from the same thread.
+    class Reactor {
+    private:
+        static const int MAX_EVENTS = 64;
+        int epfd;
+        std::map<int, Endpoint*> endpoints;
+        TimerWheel wheel;   // Every timer of every connection on this loop
+        std::vector<std::function<void()>> posted;  // Run at the end of this round
+        std::function<void()> wakeup_handler;
+        std::vector<std::unique_ptr<Endpoint>> lingering;   // Dropped by every handle, some connection in TIME_WAIT
+
+    private:
+        friend class Endpoint;
+        void add(Endpoint* ep);
+        void remove(Endpoint* ep);
+        void release(Endpoint* ep);     // Last handle gone: closed now, or once its TIME_WAIT ends
+        bool is_backlogged() const;     // Some endpoint holds datagrams back for want of kernel buffer
+
+    public:
+        Reactor();
+        Reactor(const Reactor&) = delete;
+        Reactor& operator=(const Reactor&) = delete;
+        ~Reactor();
+        std::shared_ptr<Endpoint> open();   // New UDP socket served by this loop, which keeps it through TIME_WAIT
+        void flush();   // Send everything queued on every endpoint
+        // Run f on the loop's thread after this round's datagrams and timers, never inside the caller; the next
+        // round doesn't wait while anything is posted
+        void post(std::function<void()> f) { posted.push_back(f); }
+        // Readable fd, usually an eventfd other threads write, wakes the loop and runs handler on it; one at most
+        void set_wakeup(int fd, std::function<void()> handler);
+        void run_once(int timeout_ms);  // Handle one round of datagrams and due timers, -1 waits until either
+        template<typename Pred>
+        void run_until(Pred pred) {
+            while(true) {
+                flush();
+                if(pred()) {
+                    return ;
+                }
+                run_once(-1);
+            }
+        }
+    };
+}
+
+#endif
@@ -1,132 +1,336 @@
 #include "recver.hpp"
 
 namespace jrReliableUDP {
-    Recver::Recver(int sockfd, sockaddr_in& addr, RTO& rto)
-        : sockfd(sockfd), addr(addr), rto(rto), is_rcvd_fin(false), cur_ack_num(0), RCV_NXT(0), RCV_WND(1) {
+    Recver::Recver(sockaddr_in& addr, BatchIO& io, TimerWheel& wheel)
+        : addr(addr), io(io), wheel(wheel), ack_every(ACK_EVERY), ack_delay_ms(ACK_DELAY_MS), n_unacked(0), last_ack_sent(0), last_edge(0),
+          is_rcvd_syn(false), is_rcvd_fin(false), cur_ack_num(0), ts_recent(0), rcvd_mss(BASE_MSS), rcvd_stream_buf(DEFAULT_RCV_BUF), rcvd_wscale(0), rcvd_ticket(0), has_wscale(false), wscale(0), is_wscale_fixed(false),
+          rcv_buf(DEFAULT_RCV_BUF), RCV_WND(1), n_unread(0), stream_buf(0), credit_stream(0), sack_cnt(0) {
+        ack_timer.set_handler([this]() { send_ACK(); });
+    }
+
+    void Recver::set_ack_policy(uint32_t n, int64_t delay_ms) {
+        ack_every = std::max<uint32_t>(n, 1);
+        ack_delay_ms = std::min<int64_t>(std::max<int64_t>(delay_ms, 0), MAX_ACK_DELAY_MS);
+    }
+
+    uint8_t Recver::wscale_for(uint32_t n) {
+        uint8_t s = 0;
+        while((s < MAX_WSCALE) && ((n >> s) > UINT16_MAX)) {
+            ++s;
+        }
+        return s;
+    }
+
+    void Recver::on_syn(const SynOptions& o) {
+        is_rcvd_syn = true;
+        rcvd_mss = o.mss;
+        has_wscale = o.has_wscale;
+        rcvd_wscale = o.wscale;
+        rcvd_stream_buf = o.stream_buf;
+        rcvd_ticket = o.ticket;
+        // The handshake only needed room for the SYN
+        RCV_WND = rcv_buf;
+    }
 
+    void Recver::restore_syn(uint32_t peer_isn, const SynOptions& o, uint16_t wnd_sent) {
+        is_wscale_fixed = true;
+        cur_ack_num = last_ack_sent = peer_isn + 1;
+        last_edge = cur_ack_num + wnd_sent;
+        on_syn(o);
     }
 
-    Recver::Recver(int sockfd, sockaddr_in& addr, RTO& rto, const Recver& r)
-        : sockfd(sockfd), addr(addr), rto(rto), is_rcvd_fin(false), cur_ack_num(r.cur_ack_num), RCV_NXT(0), RCV_WND(init_WND()) {
+    void Recver::set_buffer(uint32_t n) {
+        if(!is_wscale_fixed) {
+            wscale = wscale_for(n);
+        }
+        rcv_buf = std::min<uint32_t>(std::max<uint32_t>(n, 1), static_cast<uint32_t>(UINT16_MAX) << wscale);
+        if(is_rcvd_syn) {
+            RCV_WND = rcv_buf;
+        }
+    }
 
+    uint8_t Recver::announce_wscale() {
+        is_wscale_fixed = true;
+        return wscale;
     }
 
-    Recver::Recver(int sockfd, sockaddr_in& addr, RTO& rto, const Recver& r, uint16_t RCV_WND)
-        : sockfd(sockfd), addr(addr), rto(rto), is_rcvd_fin(false), cur_ack_num(r.cur_ack_num), RCV_NXT(0), RCV_WND(RCV_WND) {
+    uint32_t Recver::adv_WND() const {
+        // Room left after the in-order packets the user has not taken yet
+        return (n_unread < RCV_WND) ? RCV_WND - n_unread : 0;
+    }
 
+    uint16_t Recver::wire_WND(bool is_syn) const {
+        if(is_syn || !has_wscale) {
+            return static_cast<uint16_t>(std::min<uint32_t>(adv_WND(), UINT16_MAX));
+        }
+        // Rounded down, the peer never sends more than there is room for
+        return static_cast<uint16_t>(adv_WND() >> wscale);
     }
 
-    uint16_t Recver::init_WND() const {
-        return 8;
+    void Recver::piggyback(RawPacket& pkg) {
+        if(!is_rcvd_syn) {
+            // Nothing to acknowledge yet
+            return ;
+        }
+        pkg.type |= ACK;
+        pkg.ack_num = cur_ack_num;
+        pkg.win_size = wire_WND(IS_SYN(pkg.type));
+        pkg.ts_ecr = ts_recent;
+        n_unacked = 0;
+        last_ack_sent = cur_ack_num;
+        last_edge = cur_ack_num + (IS_SYN(pkg.type) ? pkg.win_size : (static_cast<uint32_t>(pkg.win_size) << (has_wscale ? wscale : 0)));
+        wheel.cancel(ack_timer);
     }
 
-    void Recver::cancel_timeout() {
-      timeval tv;
-      tv.tv_sec = 0;
-      tv.tv_usec = 0;
-      ::setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    uint32_t Recver::credit(uint8_t id) const {
+        auto it = streams.find(id);
+        return ((it != streams.end()) ? it->second.q.front_seq() : 0) + stream_credit();
     }
 
     void Recver::send_ACK() {
-        RawPacket pkg(0, cur_ack_num, RCV_WND - RCV_NXT, ACK);
-        char buf[sizeof(RawPacket)];
-        // ACK doesn't need retransmit and flow control
-        ::memmove(buf, &pkg, sizeof(RawPacket));
-        if(-1 == ::sendto(sockfd, buf, sizeof(RawPacket), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
-            throw std::runtime_error(jrReliableUDP::error_msg("Send error:"));
+        RawPacket pkg(una ? una() : 0, cur_ack_num, wire_WND(false), ACK);
+        pkg.ts_ecr = ts_recent;
+        // One stream's credit per ACK: the last one to send us data or to be read
+        pkg.stream = credit_stream;
+        pkg.ssn = credit(credit_stream);
+        auto it = streams.find(credit_stream);
+        if(it != streams.end()) {
+            it->second.credit_sent = pkg.ssn;
+        }
+        n_unacked = 0;
+        last_ack_sent = cur_ack_num;
+        last_edge = cur_ack_num + (static_cast<uint32_t>(pkg.win_size) << (has_wscale ? wscale : 0));
+        wheel.cancel(ack_timer);
+        if(sack_cnt > 0) {
+            // SACK blocks ride in the ACK's payload
+            pkg.buf = PacketPool::packets().alloc();
+            char* p = pkg.buf.data();
+            for(int i = 0; i < sack_cnt; ++i, p += 8) {
+                uint32_t start = htonl(sack[i].first);
+                uint32_t end = htonl(sack[i].second);
+                ::memcpy(p, &start, 4);
+                ::memcpy(p + 4, &end, 4);
+            }
+            pkg.len = sack_cnt * 8;
+        }
+        // ACK doesn't need retransmit and flow control, it is flushed with the rest of the batch
+        io.push(pkg, addr);
+    }
+
+    void Recver::update_sack(uint32_t seq) {
+        // Drop blocks the cumulative ACK has passed, merge the ones touching seq into a new first block
+        std::pair<uint32_t, uint32_t> block(seq, seq + 1);
+        int n = 0;
+        std::pair<uint32_t, uint32_t> kept[MAX_SACK_BLOCKS];
+        for(int i = 0; i < sack_cnt; ++i) {
+            if(static_cast<int32_t>(sack[i].second - cur_ack_num) <= 0) {
+                continue;
+            }
+            if(sack[i].second == block.first) {
+                block.first = sack[i].first;
+            } else if(sack[i].first == block.second) {
+                block.second = sack[i].second;
+            } else if(n < MAX_SACK_BLOCKS - 1) {
+                kept[n++] = sack[i];
+            }
+        }
+        sack_cnt = 0;
+        if(static_cast<int32_t>(block.first - cur_ack_num) > 0) {
+            sack[sack_cnt++] = block;
+        }
+        for(int i = 0; i < n; ++i) {
+            sack[sack_cnt++] = kept[i];
         }
     }
 
-    RawPacket Recver::recv_raw_packet() {
-        socklen_t len = sizeof(sockaddr_in);
-        RawPacket pkg;
-        char buf[sizeof(RawPacket)];
+    void Recver::on_packet(const RawPacket& pkg) {
     #if (defined (FAST_TRANSMIT_DEBUG)) || (defined (TIMEOUT_TRANSMIT_DEBUG))
-        int drop_cnt = 0;
+        static int drop_cnt = 0;
     #endif
-        int dup_cnt = 0;
-        cancel_timeout();
-        for(uint16_t i = RCV_NXT; i < RCV_WND; ) {
-            ::memset(&addr, 0, len);
-            if(::recvfrom(sockfd, buf, sizeof(RawPacket), 0, reinterpret_cast<sockaddr*>(&addr), &len) > 0) {
-                ::memmove(&pkg, buf, sizeof(RawPacket));
-
     #ifdef FAST_TRANSMIT_DEBUG
-                if(pkg.seq_num == 2) {
-                    ++drop_cnt;
-                    if(drop_cnt == 1) {
-                        goto RETRANSMIT;
-                    }
-                }
+        if(pkg.seq_num == 2) {
+            ++drop_cnt;
+            if(drop_cnt == 1) {
+                // Act as if it was lost
+                send_ACK();
+                return ;
+            }
+        }
     #elseif define TIMEOUT_TRANSMIT_DEBUG
-                if(pkg.seq_num == 2) {
-                    ++drop_cnt;
-                    if(drop_cnt == 1) {
-                        ::sleep(5);
-                    }
-                }
-    #endif
-    #ifdef DEBUG
-                std::cout << "Received SEQ:" << pkg.seq_num << ",";
+        if(pkg.seq_num == 2) {
+            ++drop_cnt;
+            if(drop_cnt == 1) {
+                ::sleep(5);
+            }
+        }
     #endif
-                if(cur_ack_num == pkg.seq_num) {
-                    dup_cnt = 0;
-                    ++cur_ack_num;
-                    rwnd[pkg.seq_num] = pkg;
-                    send_ACK();
     #ifdef DEBUG
-                    std::cout << "Sent ACK:" << cur_ack_num << std::endl;
+        std::cout << "Received SEQ:" << pkg.seq_num << ",";
     #endif
-                    if(IS_RST(pkg.type)) {
-                        ::close(sockfd);
-                        std::runtime_error("Connection reset by peer.");
+        if((!is_rcvd_syn || seq_le(pkg.seq_num, last_ack_sent)) && ((ts_recent == 0) || (static_cast<int32_t>(pkg.ts_val - ts_recent) >= 0))) {
+            // RFC 7323: echo the newest packet at or left of the last ACK sent. Out-of-order ones would shrink the
+            // measured RTT, a retransmission of data already received means the ACK for it got lost, and with
+            // delayed ACKs the echo is the oldest packet waiting, so the RTT includes the delay.
+            ts_recent = pkg.ts_val;
+        }
+        if(!is_rcvd_syn && IS_SYN(pkg.type) && rwnd.empty()) {
+            // The peer's ISN: whatever an active end picked, the cookie from a listener using SYN cookies
+            cur_ack_num = last_ack_sent = last_edge = pkg.seq_num;
+        }
+        uint32_t offset = pkg.seq_num - cur_ack_num;
+        bool is_immediate = true;
+        RxStream* stream = nullptr;
+        if(IS_DATA(pkg.type) && (pkg.stream != DGRAM_STREAM)) {
+            stream = &streams.emplace(pkg.stream, RxStream(stream_credit())).first->second;
+        }
+        // Within the window no stream runs further ahead of what its user read than RCV_WND packets
+        if((offset < adv_WND()) && (!stream || (pkg.ssn - stream->q.front_seq() < RCV_WND))) {
+            bool had_gap = (sack_cnt > 0);
+            // Inside the advertised window: buffer it even if it is out of order
+            if(rwnd.empty()) {
+                rwnd.reset(cur_ack_num);
+            }
+            bool is_new = (rwnd.state(pkg.seq_num) == EMPTY);
+            if(is_new && IS_DATA(pkg.type) && (pkg.stream == DGRAM_STREAM)) {
+                // Handed over at once; a skipped one only fills its SEQ
+                rwnd.put(pkg.seq_num, pkg, IS_SKIP(pkg.type) ? ACKED : RECEIVED);
+                if(!IS_SKIP(pkg.type)) {
+                    dgrams.push_back(pkg);
+                }
+            } else if(is_new) {
+                rwnd.put(pkg.seq_num, pkg, RECEIVED);
+                if(stream) {
+                    // Readable as soon as its own stream is in order, whatever other streams still miss
+                    stream->q.put(pkg.ssn, pkg, RECEIVED);
+                    credit_stream = pkg.stream;
+                }
+            }
+            if(offset == 0) {
+                // Fill the hole and move over every packet buffered behind it
+                for(SlotState st = rwnd.state(cur_ack_num); (st == RECEIVED) || (st == ACKED); st = rwnd.state(cur_ack_num)) {
+                    const RawPacket& p = rwnd.at(cur_ack_num);
+                    if(IS_SYN(p.type)) {
+                        on_syn(SynOptions(p));
                     }
-                    if(IS_FIN(pkg.type)) {
+                    if(IS_FIN(p.type)) {
                         is_rcvd_fin = true;
-                        RCV_NXT = RCV_WND;
-                        break;
                     }
-                    ++i;
-                    ++RCV_NXT;
-                } else if(cur_ack_num < pkg.seq_num) {
-    #ifdef FAST_TRANSMIT_DEBUG
-    RETRANSMIT:
-    #endif
-                    if(dup_cnt < DUPTHRESH) {
-                        send_ACK();
-    #ifdef DEBUG
-                        std::cout << "Sent ACK:" << cur_ack_num << std::endl;
-    #endif
-                    } else {
-    #ifdef DEBUG
-                        std::cout << "Droped." << std::endl;
-    #endif
+                    if(IS_DATA(p.type) && (st == RECEIVED)) {
+                        // Still waiting in its stream, from now on it holds the window
+                        ++n_unread;
                     }
-                    ++dup_cnt;
+                    rwnd.pop_front();
+                    ++cur_ack_num;
                 }
+            }
+            if(is_new) {
+                update_sack(pkg.seq_num);
+            }
+            // Only a new in-order packet with no hole around may wait for the next one, and only if the window
+            // we advertised leaves the peer room to send it
+            is_immediate = !is_new || (offset != 0) || had_gap || IS_SYN(pkg.type) || IS_FIN(pkg.type)
+                           || (++n_unacked >= ack_every) || (ack_delay_ms == 0)
+                           || (static_cast<int32_t>(last_edge - cur_ack_num) < static_cast<int32_t>(ack_every));
+        }
+        if(is_immediate && IS_SYN(pkg.type) && !is_wscale_fixed) {
+            // Our SYN is yet to announce its scale and leaves right after carrying the ACK, one SYN+ACK; the timer
+            // only stands in if it doesn't
+            wheel.schedule(ack_timer, get_now_ms());
+        } else if(is_immediate) {
+            // A duplicate (its ACK was lost) or beyond the window also lands here: tell the peer where we are
+            send_ACK();
+        } else if(!ack_timer.is_armed()) {
+            wheel.schedule(ack_timer, get_now_ms() + ack_delay_ms);
+        }
     #ifdef DEBUG
-                else {
-                        std::cout << "Droped." << std::endl;
+        std::cout << "Sent ACK:" << cur_ack_num << std::endl;
+    #endif
+    }
 
-                }
-     #endif
-            } else {
-                throw std::runtime_error(error_msg("Recv failed"));
-            }
+    void Recver::on_probe(const RawPacket& pkg) {
+        if(pkg.len == pkg.seq_num) {
+            io.push(RawPacket(pkg.seq_num, 0, 0, PROBE | ACK), addr);
         }
-        RawPacket ret;
-        if(!rwnd.empty()) {
-            ret = rwnd.begin()->second;
-            rwnd.erase(rwnd.begin());
-            if(!is_rcvd_fin) {
-                --RCV_NXT;
-            }
+    }
+
+    bool Recver::readable(uint8_t id) const {
+        auto it = streams.find(id);
+        return is_rcvd_fin || ((it != streams.end()) && (it->second.q.state(it->second.q.front_seq()) == RECEIVED));
+    }
+
+    void Recver::release(uint32_t seq) {
+        if(seq_lt(seq, cur_ack_num)) {
+            --n_unread;
         } else {
-            ret.data[0] = '\0';
-            if(is_rcvd_fin) {
-                ret.type |= FIN;
+            // Taken before the packets in front of it arrived, it never counts against the window
+            rwnd.set_state(seq, ACKED);
+        }
+    }
+
+    void Recver::pop(uint8_t id) {
+        RxStream& s = streams.find(id)->second;
+        release(s.q.at(s.q.front_seq()).seq_num);
+        s.q.pop_front();
+        s.read_off = 0;
+        update_window(&s, id);
+    }
+
+    RawPacket Recver::recv_datagram() {
+        RawPacket ret = dgrams.front();
+        dgrams.pop_front();
+        release(ret.seq_num);
+        update_window(nullptr, DGRAM_STREAM);
+        return ret;
+    }
+
+    void Recver::update_window(const RxStream* s, uint8_t id) {
+        // Window update once it reopens, the peer's persist timer would take its time to find out, or once it
+        // grew by half the buffer, the peer may be stalled on the edge it knows; the same for the stream's credit
+        int32_t grown = static_cast<int32_t>(cur_ack_num + adv_WND() - last_edge);
+        int32_t credited = s ? static_cast<int32_t>(credit(id) - s->credit_sent) : 0;
+        if(is_rcvd_syn && (wire_WND(false) != 0)
+           && ((last_edge == last_ack_sent) || (grown >= static_cast<int32_t>(std::max<uint32_t>(RCV_WND / 2, 1)))
+               || (credited >= static_cast<int32_t>(std::max<uint32_t>(stream_credit() / 2, 1))))) {
+            if(s) {
+                credit_stream = id;
             }
+            send_ACK();
+        }
+    }
+
+    RawPacket Recver::recv_raw_packet(uint8_t id) {
+        RawPacket ret;
+        auto it = streams.find(id);
+        if((it != streams.end()) && (it->second.q.state(it->second.q.front_seq()) == RECEIVED)) {
+            RxStream& s = it->second;
+            ret = s.q.at(s.q.front_seq());
+            // Whatever stream reads left of it
+            ret.off += s.read_off;
+            ret.len -= s.read_off;
+            pop(id);
+        } else if(is_rcvd_fin) {
+            ret.type |= FIN;
         }
         return ret;
     }
+
+    size_t Recver::read(uint8_t id, char* dst, size_t n) {
+        auto it = streams.find(id);
+        if(it == streams.end()) {
+            return 0;
+        }
+        RxStream& s = it->second;
+        size_t copied = 0;
+        while((copied < n) && (s.q.state(s.q.front_seq()) == RECEIVED)) {
+            const RawPacket& p = s.q.at(s.q.front_seq());
+            size_t k = std::min<size_t>(n - copied, p.len - s.read_off);
+            ::memcpy(dst + copied, p.payload() + s.read_off, k);
+            copied += k;
+            s.read_off += k;
+            if(s.read_off == p.len) {
+                pop(id);
+            }
+        }
+        return copied;
+    }
 }
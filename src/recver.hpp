@@ -1,32 +1,105 @@
 #ifndef RECVER_H
 #define RECVER_H
 
-#include "defs.hpp"
+#include "io.hpp"
+#include "ring.hpp"
+#include "timer.hpp"
+#include <map>
+#include <deque>
 
 namespace jrReliableUDP {
+    // One ordered stream on the receive side, independent of every other stream's losses
+    struct RxStream {
+        Ring<RawPacket> q;  // By SSN from the first packet not taken by the user, holes are EMPTY
+        uint16_t read_off;  // Bytes of the first packet already read in stream mode
+        uint32_t credit_sent;   // Right edge last advertised for it, SSN
+
+        explicit RxStream(uint32_t credit) : read_off(0), credit_sent(credit) {}
+    };
+
+    // Never blocks: the event loop feeds packets in, the user takes the in-order ones out
     class Recver {
     private:
-        int sockfd;
         sockaddr_in& addr;
-        RTO& rto;
+        BatchIO& io;
+        TimerWheel& wheel;
+        Timer ack_timer;    // Delayed ACK
+        uint32_t ack_every;
+        int64_t ack_delay_ms;
+        uint32_t n_unacked;     // In-order packets since the last ACK
+        uint32_t last_ack_sent;
+        uint32_t last_edge;     // Right edge of the window last advertised, SEQ
+        bool is_rcvd_syn;
         bool is_rcvd_fin;
-        uint32_t cur_ack_num;
-        uint16_t RCV_NXT;
-        uint16_t RCV_WND;
-        std::map<uint32_t, RawPacket> rwnd;
+        uint32_t cur_ack_num;   // First SEQ not yet received
+        uint32_t ts_recent; // Newest TSval at or left of the last ACK sent, echoed in every ACK
+        uint16_t rcvd_mss;  // Announced in the peer's SYN
+        uint32_t rcvd_stream_buf;
+        uint8_t rcvd_wscale;
+        uint64_t rcvd_ticket;   // Resumption ticket the peer's SYN handed us, 0 for none
+        bool has_wscale;    // The peer's SYN announced a scale, windows are scaled both ways after the SYNs
+        uint8_t wscale;     // Ours, fixed once announced
+        bool is_wscale_fixed;
+        uint32_t rcv_buf;
+        uint32_t RCV_WND;
+        Ring<RawPacket> rwnd;   // From cur_ack_num, what arrived out of order; ACKED once its stream took it early
+        std::map<uint8_t, RxStream> streams;    // Data packets wait in their stream's queue until the user takes them
+        std::deque<RawPacket> dgrams;   // DGRAM_STREAM, in arrival order
+        uint32_t n_unread;  // Data packets left of cur_ack_num still in a stream's queue, they hold the window
+        uint32_t stream_buf;    // Credit of each stream in packets, 0 for the whole receive buffer
+        uint8_t credit_stream;  // The stream whose credit the next pure ACK carries
+        std::pair<uint32_t, uint32_t> sack[MAX_SACK_BLOCKS];    // Out-of-order ranges, most recent first
+        int sack_cnt;
+        std::function<uint32_t()> una;  // The sender's SND.UNA
 
     private:
-        uint16_t init_WND() const;
-        void cancel_timeout();
         void send_ACK();
+        void update_sack(uint32_t seq);
+        void on_syn(const SynOptions& o);   // The peer's SYN is in
+        uint32_t credit(uint8_t id) const;  // First SSN of the stream the peer has no room for
+        void release(uint32_t seq);     // The user took the packet, it stops holding the window
+        void update_window(const RxStream* s, uint8_t id);  // Tell the peer about room the user made, if that matters
+        void pop(uint8_t id);   // Release the stream's first packet
 
     public:
-        Recver(int sockfd, sockaddr_in& addr, RTO& rto);
-        Recver(int sockfd, sockaddr_in& addr, RTO& rto, const Recver& r);
-        Recver(int sockfd, sockaddr_in& addr, RTO& rto, const Recver& r, uint16_t RCV_WND);
-        void set_WND() { RCV_WND = init_WND(); }
-        void reset_WND() { RCV_WND = 1; }
-        RawPacket recv_raw_packet();
+        Recver(sockaddr_in& addr, BatchIO& io, TimerWheel& wheel);
+        // ACK every n in-order packets, or after delay_ms for a lone one; gaps, duplicates, SYN and FIN are
+        // always ACKed at once. n = 1 ACKs everything immediately. The delay is capped at MAX_ACK_DELAY_MS.
+        void set_ack_policy(uint32_t n, int64_t delay_ms);
+        void piggyback(RawPacket& pkg);     // Let an outgoing packet carry the pending ACK
+        // Pure ACKs carry the sender's SND.UNA as their SEQ: a listener restoring a connection from a SYN cookie
+        // learns the peer's ISN from it, one below, whatever data went with the SYN unacked
+        void set_seq_source(std::function<uint32_t()> f) { una = f; }
+        void stop_timers() { wheel.cancel(ack_timer); }
+        // Receive window in packets, the smallest scale that fits it is picked until announce_wscale
+        void set_buffer(uint32_t n);
+        uint8_t announce_wscale();  // The scale our SYN carries, fixed from now on
+        static uint8_t wscale_for(uint32_t n);  // Smallest shift that fits a window of n packets in 16 bits
+        // Our SYN, answered with a cookie, was acked; the peer's as the cookie kept it, wnd_sent the window offered
+        void restore_syn(uint32_t peer_isn, const SynOptions& o, uint16_t wnd_sent);
+        uint32_t buffer() const { return rcv_buf; }
+        // Packets of one stream the user may leave unread before its sender waits, so a stream nobody reads
+        // can't take the whole window from the others
+        void set_stream_buffer(uint32_t n) { stream_buf = n; }
+        uint32_t stream_credit() const { return stream_buf ? std::min(stream_buf, rcv_buf) : rcv_buf; }
+        uint32_t ack_num() const { return cur_ack_num; }
+        uint32_t adv_WND() const;
+        uint16_t wire_WND(bool is_syn) const;   // adv_WND as the header carries it, never scaled in a SYN
+        bool rcvd_syn() const { return is_rcvd_syn; }
+        uint16_t peer_mss() const { return rcvd_mss; }
+        uint8_t peer_wscale() const { return has_wscale ? rcvd_wscale : 0; }
+        uint32_t peer_stream_buf() const { return rcvd_stream_buf; }
+        uint64_t peer_ticket() const { return rcvd_ticket; }
+        bool rcvd_fin() const { return is_rcvd_fin; }
+        bool readable(uint8_t id) const;
+        void on_packet(const RawPacket& pkg);   // Buffer a SYN, FIN or data packet and ACK it
+        void on_probe(const RawPacket& pkg);    // Echo a PMTU probe, it got through whole
+        // Next packet of the stream in its order, or an empty FIN once the peer closed; only when readable(id)
+        RawPacket recv_raw_packet(uint8_t id);
+        bool has_datagram() const { return !dgrams.empty(); }
+        RawPacket recv_datagram();  // Oldest datagram not taken yet, only when has_datagram()
+        // Stream mode: copy up to n bytes of the stream into dst regardless of packet bounds, 0 once only the FIN is left
+        size_t read(uint8_t id, char* dst, size_t n);
     };
 }
 
@@ -0,0 +1,92 @@
+#ifndef RING_H
+#define RING_H
+
+#include "defs.hpp"
+#include <vector>
+
+namespace jrReliableUDP {
+    enum SlotState : uint8_t {EMPTY, QUEUED, SENT, RETRANSMIT, ACKED, RECEIVED};
+
+    // Send/receive window indexed by SEQ: slot = seq & mask, capacity is a power of two
+    template<typename T>
+    class Ring {
+    private:
+        struct Slot {
+            T item;
+            SlotState state;
+            Slot() : state(EMPTY) {}
+        };
+
+        std::vector<Slot> slots;
+        uint32_t mask;
+        uint32_t head;  // SEQ of the first slot
+        uint32_t tail;  // One past the SEQ of the last slot
+
+    private:
+        void grow(uint32_t need) {
+            size_t cap = slots.size();
+            while(cap < need) {
+                cap <<= 1;
+            }
+            std::vector<Slot> bigger(cap);
+            for(uint32_t seq = head; seq != tail; ++seq) {
+                bigger[seq & (cap - 1)] = slots[seq & mask];
+            }
+            slots.swap(bigger);
+            mask = cap - 1;
+        }
+
+    public:
+        explicit Ring(size_t capacity = RING_INIT_SIZE) : mask(0), head(0), tail(0) {
+            size_t cap = 1;
+            while(cap < capacity) {
+                cap <<= 1;
+            }
+            slots.resize(cap);
+            mask = cap - 1;
+        }
+
+        // Drop everything and start the window at seq
+        void reset(uint32_t seq) {
+            for(; head != tail; ++head) {
+                slots[head & mask] = Slot();
+            }
+            head = tail = seq;
+        }
+
+        bool empty() const { return head == tail; }
+        uint32_t size() const { return tail - head; }
+        uint32_t front_seq() const { return head; }
+        uint32_t end_seq() const { return tail; }
+        bool contains(uint32_t seq) const { return seq - head < tail - head; }   // Wraparound safe
+        T& at(uint32_t seq) { return slots[seq & mask].item; }
+        const T& at(uint32_t seq) const { return slots[seq & mask].item; }
+        SlotState state(uint32_t seq) const { return contains(seq) ? slots[seq & mask].state : EMPTY; }
+        void set_state(uint32_t seq, SlotState s) { slots[seq & mask].state = s; }
+
+        // Store item at seq (at or after the head), slots skipped over stay EMPTY
+        T& put(uint32_t seq, const T& item, SlotState s) {
+            if(seq - head >= tail - head) {
+                if(seq - head + 1 > slots.size()) {
+                    grow(seq - head + 1);
+                }
+                for(; tail != seq; ++tail) {
+                    slots[tail & mask].state = EMPTY;
+                }
+                tail = seq + 1;
+            }
+            Slot& slot = slots[seq & mask];
+            slot.item = item;
+            slot.state = s;
+            return slot.item;
+        }
+
+        void pop_front() {
+            // The item goes too, so a pooled buffer it holds is back in its pool now, not when the slot comes round
+            slots[head & mask] = Slot();
+            ++head;
+        }
+    };
+}
+
+#endif
@@ -1,201 +1,632 @@
 #include "sender.hpp"
+#include <cmath>
 
 namespace jrReliableUDP {
-    Sender::Sender(int sockfd, sockaddr_in& addr, RTO& rto)
-        : sockfd(sockfd), addr(addr), rto(rto), cur_seq_num(0), dupack_cnt(1),
-        SND_NXT(0), SND_WND(1), CONG_WND(1), ssthresh(init_ssthresh()), is_fast_recover(false) {
-
+    Sender::Sender(sockaddr_in& addr, RTO& rto, BatchIO& io, TimerWheel& wheel)
+        : addr(addr), rto(rto), io(io), cur_seq_num(init_seq_num()), dupack_cnt(0), SND_NXT(cur_seq_num), RTX_NXT(cur_seq_num),
+        SND_WND(1), max_wnd(0), last_wnd(1), snd_wscale(0), pipe(0), high_sack(cur_seq_num), recover(cur_seq_num), wheel(wheel), persist_ms(0),
+        pacing(PACING_OFF), tokens(0), refill_us(0), next_tx_ns(0),
+        rr_last(0), n_queued(0), init_credit(DEFAULT_RCV_BUF), is_fin_pending(false), is_nodelay(false), mss(BASE_MSS), max_mss(BASE_MSS), probe_ceil(BASE_MSS), probe_mss(0), probe_cnt(0),
+        cc(CongestionControl::create(RENO)), is_fast_recover(false), is_cwnd_limited(false),
+        delivered(0), delivered_us(0), first_sent_us(0), app_limited(0), last_tx_us(0) {
+        swnd.reset(cur_seq_num);
+        persist_timer.set_handler([this]() { on_persist(); });
+        pace_timer.set_handler([this]() { send_pkgs_in_buf(); });
+        probe_timer.set_handler([this]() { on_probe_timer(); });
     }
 
-    Sender::Sender(int sockfd, sockaddr_in& addr, RTO& rto, const Sender& s)
-        : sockfd(sockfd), addr(addr), rto(rto), cur_seq_num(s.cur_seq_num), dupack_cnt(1),
-        SND_NXT(0), SND_WND(init_WND()), CONG_WND(1), ssthresh(init_ssthresh()), is_fast_recover(false) {
-
+    uint32_t Sender::init_seq_num() const {
+        return 0;
     }
 
-    Sender::Sender(int sockfd, sockaddr_in& addr, RTO& rto, const Sender& s, uint16_t SND_WND)
-        : sockfd(sockfd), addr(addr), rto(rto), cur_seq_num(s.cur_seq_num), dupack_cnt(1),
-        SND_NXT(0), SND_WND(SND_WND), CONG_WND(1), ssthresh(init_ssthresh()), is_fast_recover(false) {
+    void Sender::restart_timer() {
+        wheel.schedule(rtx_timer, get_now_ms() + rto.timeout_ms());
+    }
 
+    void Sender::stop_timers() {
+        wheel.cancel(rtx_timer);
+        wheel.cancel(persist_timer);
+        wheel.cancel(pace_timer);
+        wheel.cancel(probe_timer);
     }
 
-    uint32_t Sender::init_seq_num() const {
-        return 0;
+    void Sender::on_persist() {
+        if((pipe != 0) || ((SND_NXT == swnd.end_seq()) && !pull(true))) {
+            return ;
+        }
+        if(SND_WND != 0) {
+            // Every stream with data is out of credit and the update may have been lost: one packet goes past it,
+            // the ACK it draws carries its stream's credit
+            send_pkgs_in_buf();
+#ifdef DEBUG
+            std::cout << "Sent credit probe SEQ:" << swnd.end_seq() - 1 << std::endl;
+#endif
+            return ;
+        }
+        // Probe with the next packet beyond the window, outside the pipe; its ACK carries the reopened window
+        abandon_if_due(swnd.at(SND_NXT), false, get_now_ms());
+        stamp(SND_NXT, get_now_us());
+        if(piggyback) {
+            piggyback(swnd.at(SND_NXT).pkg);
+        }
+        io.push(swnd.at(SND_NXT).pkg, addr);
+        persist_ms = std::min<int64_t>(persist_ms * 2, PERSIST_MAX);
+        wheel.schedule(persist_timer, get_now_ms() + persist_ms);
+#ifdef DEBUG
+        std::cout << "Sent window probe SEQ:" << SND_NXT << std::endl;
+#endif
     }
 
-    uint16_t Sender::init_WND() const {
-        return 8;
+    uint32_t Sender::usable_WND() const {
+        return SND_WND;
     }
 
-    uint16_t Sender::init_ssthresh() const {
-        return 8;
+    void Sender::stamp(uint32_t seq, int64_t now_us) {
+        TxPacket& p = swnd.at(seq);
+        // Stamped at every transmission, so the echo tells a retransmission's ACK from the original's
+        p.pkg.ts_val = static_cast<uint32_t>(now_us);
+        if(pipe == 0) {
+            // Nothing in flight: the sampling interval starts over, idle time is not counted
+            first_sent_us = delivered_us = now_us;
+        }
+        p.tx.sent_us = now_us;
+        last_tx_us = now_us;
+        p.tx.first_sent_us = first_sent_us;
+        p.tx.delivered_us = delivered_us;
+        p.tx.delivered = delivered;
+        p.tx.is_app_limited = (app_limited != 0);
     }
 
-    void Sender::set_timeout() {
-      timeval tv;
-      tv.tv_sec = 0;
-      tv.tv_usec = rto.backoff_factor*rto.RTO_ms*1000;
-      ::setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    bool Sender::pace(int64_t now_us, uint64_t& txtime_ns) {
+        txtime_ns = 0;
+        double rate = cc->pacing_rate();
+        if((pacing == PACING_OFF) || (rate <= 0)) {
+            // Unpaced until the controller knows a rate
+            return true;
+        }
+        if(pacing == PACING_TXTIME) {
+            // Everything leaves the loop now, the qdisc spaces it out
+            next_tx_ns = std::max(next_tx_ns, now_us * 1000);
+            txtime_ns = static_cast<uint64_t>(next_tx_ns);
+            next_tx_ns += static_cast<int64_t>(1e9 / rate);
+            return true;
+        }
+        // A timer tick's worth may leave at once: the wheel can't wake us more often
+        double depth = std::max<double>(PACING_BURST, rate / 1000);
+        tokens = std::min(depth, tokens + (now_us - refill_us) * rate / 1e6);
+        refill_us = now_us;
+        if(tokens >= 1) {
+            tokens -= 1;
+            return true;
+        }
+        if(!pace_timer.is_armed()) {
+            int64_t wait_ms = static_cast<int64_t>(std::ceil((1 - tokens) * 1000 / rate));
+            wheel.schedule(pace_timer, get_now_ms() + std::max<int64_t>(wait_ms, 1));
+        }
+        return false;
     }
 
     void Sender::send_pkgs_in_buf() {
-        char buf[sizeof(RawPacket)];
-        auto it = swnd.begin();
-        std::advance(it, SND_NXT);
-        RawPacket p = it->second;
-        ::memmove(buf, &p, sizeof(RawPacket));
-        if(-1 == ::sendto(sockfd, buf, sizeof(RawPacket), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
-            throw std::runtime_error(jrReliableUDP::error_msg("Send error:"));
-        }
-        ++SND_NXT;
+        bool is_sent = false;
+        bool is_drained = false;    // Stopped for want of data rather than window
+        int64_t now_us = get_now_us();
+        while(pipe < usable_WND()) {
+            uint32_t seq;
+            // Lost packets go out before new ones
+            while((RTX_NXT != SND_NXT) && (swnd.state(RTX_NXT) != RETRANSMIT)) {
+                ++RTX_NXT;
+            }
+            bool is_rtx = (RTX_NXT != SND_NXT);
+            // New data never goes past the right edge SND.UNA + RCV.WND, even with SACKed holes in the pipe; the
+            // congestion window limits only the pipe, or a hole would hold back every stream after a cwnd of packets.
+            // Streams get their SEQ only now, so the scheduler decides with what is waiting at this moment.
+            if(!is_rtx && (SND_NXT - swnd.front_seq() >= last_wnd)) {
+                break;
+            }
+            if(!is_rtx && (SND_NXT == swnd.end_seq()) && !pull(false)) {
+                is_drained = true;
+                break;
+            }
+            uint64_t txtime_ns;
+            if(!pace(now_us, txtime_ns)) {
+                break;
+            }
+            seq = is_rtx ? RTX_NXT++ : SND_NXT++;
+            abandon_if_due(swnd.at(seq), is_rtx, now_us / 1000);
+            // The send time is when it leaves the qdisc, or the echoed RTT would include the pacing delay
+            stamp(seq, (txtime_ns != 0) ? static_cast<int64_t>(txtime_ns / 1000) : now_us);
+            if(piggyback) {
+                // Rewritten on every transmission, a retransmission carries the current ACK
+                piggyback(swnd.at(seq).pkg);
+            }
+            io.push(swnd.at(seq).pkg, addr, txtime_ns);
+            swnd.set_state(seq, SENT);
+            ++pipe;
+            is_sent = true;
 #ifdef DEBUG
-            std::cout << "Sent SEQ:" << cur_seq_num << ",";
+            std::cout << "Sent SEQ:" << seq << std::endl;
 #endif
-        if(SND_NXT == SND_WND) {
-            // SND size reached SND_WND
-            wait_ack();
-            SND_NXT = 0;
         }
-#ifdef DEBUG
-        else {
-             std::cout << std::endl;
+        is_cwnd_limited = (pipe >= cc->cwnd());
+        if(is_drained && (RTX_NXT == SND_NXT) && (pipe < cc->cwnd())) {
+            // Out of data before the window: rate samples until these are delivered understate the path
+            app_limited = std::max<uint64_t>(delivered + pipe, 1);
+        }
+        if(is_sent && !rtx_timer.is_armed()) {
+            restart_timer();
+        }
+        if((pipe == 0) && ((SND_NXT != swnd.end_seq()) || (n_queued != 0)) && !pace_timer.is_armed() && !persist_timer.is_armed()) {
+            // Peer's RCV.WND or the credit of every stream with data is 0 and nothing in flight would bring
+            // its update: start probing
+            persist_ms = rto.timeout_ms();
+            wheel.schedule(persist_timer, get_now_ms() + persist_ms);
+        }
+    }
+
+    void Sender::on_delivered(const TxStamp& tx, int64_t now_us, TxStamp& newest) {
+        ++delivered;
+        delivered_us = now_us;
+        if(tx.sent_us == 0) {
+            // A window probe, never stamped
+            return ;
+        }
+        if(tx.sent_us >= newest.sent_us) {
+            // The rate is measured over the flight of the most recently sent packet acked
+            newest = tx;
+            first_sent_us = tx.sent_us;
         }
-#endif
     }
 
-    void Sender::wait_ack() {
-        char buf[sizeof(RawPacket)];
-        // Wait ACK and Retransmit function
-        socklen_t len = sizeof(sockaddr_in);
-        RawPacket ack_pkg;
-        uint16_t uSND_WND = SND_WND;
-        auto it = swnd.begin();
-        for(uint16_t cnt = 0; (cnt<SND_WND) && (it!=swnd.end()); ) {
-            set_timeout();
-            if(::recvfrom(sockfd, buf, sizeof(RawPacket), 0, reinterpret_cast<sockaddr*>(&addr), &len) > 0) {
-                ::memmove(&ack_pkg, buf, sizeof(RawPacket));
-                if(IS_ACK(ack_pkg.type)) {
-                    int64_t rtt = get_time_diff_from_now_ms(ack_pkg.timestamp);
-                    rto.update_RTO_ms(rtt);
-                    // ACK arrived
-                    uSND_WND = std::min(ack_pkg.win_size, CONG_WND); // update SND.WND by RCV.WND
-                    uint32_t last_seq = it->first;
-    #ifdef DEBUG
-                    std::cout << "Received ACK:" << ack_pkg.ack_num << ",";
-                    std::cout << "Last SEQ:" << last_seq << ",";
-                    std::cout << "RTT=" << rtt << "ms" << ",";
-                    std::cout << "SRTT=" << rto.srtt << ",";
-                    std::cout << "RTTVAR=" << rto.rttvar << ",";
-                    std::cout << "RTO=" << rto.RTO_ms << "ms" << std::endl;
-    #endif
-                    if(ack_pkg.ack_num >= last_seq + 1) {
-                        // Correct ACK
-                        it = swnd.erase(it);  // Update sent buffer
-                        dupack_cnt = 1; // Reset counter
-                        // Slow start, congestion window size index inc
-                        if(CONG_WND < ssthresh) {
-                            ++CONG_WND;
-                        }
-                        // Cancel fast recover
-                        if(is_fast_recover) {
-                            is_fast_recover = false;
-                        }
-                        ++cnt;
-                    } else {
-                        // Duplicate ACK
-                        if(dupack_cnt == DUPTHRESH) {
-                            // Update sent buffer
-                            swnd.erase(swnd.begin(), swnd.find(ack_pkg.ack_num));
-                            // Reset counter
-                            dupack_cnt = 1;
-                            // Retransmition
-                            // Fast retransmition's congestion occurs
-                            CONG_WND = CONG_WND / 2;
-                            ssthresh = CONG_WND;
-                            // Fast recover
-                            if(!is_fast_recover) {
-                                is_fast_recover = true;
-                                CONG_WND = ssthresh + DUPTHRESH;
-                            }
-                            break;
-                        } else {
-                            ++dupack_cnt;
-                            ++it;
-                            ++cnt;
-                        }
-                        if(is_fast_recover) {
-                            ++CONG_WND;
-                        }
+    void Sender::on_ack(const RawPacket& ack_pkg) {
+#ifdef DEBUG
+        std::cout << "Received ACK:" << ack_pkg.ack_num << std::endl;
+#endif
+        int64_t now_us = get_now_us();
+        TxStamp newest;
+        uint32_t n_delivered = 0;
+        bool was_cwnd_limited = is_cwnd_limited;
+        uint32_t win = IS_SYN(ack_pkg.type) ? ack_pkg.win_size : (static_cast<uint32_t>(ack_pkg.win_size) << snd_wscale);
+        if(!swnd.empty()) {
+            uint32_t una = swnd.front_seq();
+            // RFC 5681: only a pure ACK of SND.UNA with data outstanding can be a duplicate. Data the peer sends
+            // carries the same ACK over and over, and a delayed ACK may only tell that the application read.
+            bool is_dupack = (ack_pkg.type == ACK) && (ack_pkg.ack_num == una) && (una != SND_NXT);
+            if(swnd.contains(ack_pkg.ack_num - 1)) {
+                // Cumulative ACK, slide the send window over every packet it covers
+                while(swnd.front_seq() != ack_pkg.ack_num) {
+                    SlotState st = swnd.state(swnd.front_seq());
+                    if(st == SENT) {
+                        --pipe;
                     }
-                } else if(IS_RST(ack_pkg.type)) {
-                    // RST arrived
-                    throw std::runtime_error("Connection closed by peer.");
-                }
-            } else {
-                if(errno == EAGAIN) {
-                    // If the waiting time exceeds the upper limit of the timeout, the current end considers that the peer end is closed
-                    if(rto.RTO_ms > MAX_WAIT_TIME) {
-                        throw std::runtime_error("Connection closed by peer.");
+                    if(st != ACKED) {
+                        // SACKed ones were counted when their block arrived
+                        on_delivered(swnd.at(swnd.front_seq()).tx, now_us, newest);
+                        ++n_delivered;
                     }
-                    // Backoff
-                    rto.backoff_factor *= 2;
-                    // Recv ACK timeout, retransmit, DO NOT slide the send window
-                    // Timeout retransmition's congestion occurs
-                    ssthresh = CONG_WND / 2;
-                    CONG_WND = 1;
+                    swnd.pop_front();
+                }
+                int32_t rtt_us = static_cast<int32_t>(static_cast<uint32_t>(now_us) - ack_pkg.ts_ecr);
+                if((ack_pkg.ts_ecr != 0) && (rtt_us >= 0)) {
+                    // Karn: sample only on ACKs that advance SND.UNA, timed by the echoed send time of the
+                    // transmission that advanced it, never by a retransmission's original. A departure time
+                    // still ahead means no qdisc honoured SO_TXTIME, the sample is meaningless.
+                    update_RTT(rtt_us);
+                }
+                if(seq_lt(SND_NXT, swnd.front_seq())) {
+                    // A window probe got in
+                    SND_NXT = swnd.front_seq();
+                }
+                if(seq_lt(RTX_NXT, swnd.front_seq())) {
+                    RTX_NXT = swnd.front_seq();
+                }
+                // New data acked: restart the timer for what is still outstanding
+                if(SND_NXT != swnd.front_seq()) {
+                    restart_timer();
                 } else {
-                    throw std::runtime_error(jrReliableUDP::error_msg("Send failed"));
+                    wheel.cancel(rtx_timer);
+                }
+                dupack_cnt = 0;
+                if(is_fast_recover && seq_le(recover, ack_pkg.ack_num)) {
+                    // Recovery finished once everything outstanding at its start is acked, deflate the window
+                    is_fast_recover = false;
+                    cc->on_recovery_end();
+                }
+            }
+            if(seq_lt(high_sack, swnd.front_seq())) {
+                high_sack = swnd.front_seq();
+            }
+            uint32_t old_high_sack = on_sack(ack_pkg, now_us, newest, n_delivered);
+            // Counted if the window is unchanged, or whatever the window if it SACKed something new (RFC 6675);
+            // nothing was acked cumulatively, so anything delivered came from its blocks
+            if(is_dupack && ((win == last_wnd) || (n_delivered != 0))) {
+                ++dupack_cnt;
+            }
+            if(!is_fast_recover && (dupack_cnt >= DUPTHRESH)) {
+                // Fast retransmition's congestion occurs
+                cc->on_loss(SND_NXT - swnd.front_seq(), now_us);
+                is_fast_recover = true;
+                recover = SND_NXT;
+                // Only the holes below the highest SACKed packet are resent, or just SND.UNA without SACK
+                mark_lost(swnd.front_seq(), (high_sack != swnd.front_seq()) ? high_sack : swnd.front_seq() + 1);
+            } else if(is_fast_recover && seq_lt(old_high_sack, high_sack)) {
+                // Holes newly uncovered by SACK during recovery
+                mark_lost(old_high_sack, high_sack);
+            }
+        }
+        if(n_delivered > 0) {
+            if((app_limited != 0) && (delivered > app_limited)) {
+                app_limited = 0;
+            }
+            AckSample sample;
+            sample.now_us = now_us;
+            sample.acked = n_delivered;
+            sample.pipe = pipe;
+            sample.delivered = delivered;
+            sample.prior_delivered = newest.delivered;
+            sample.delivery_rate = 0;
+            sample.is_app_limited = newest.is_app_limited;
+            sample.is_cwnd_limited = was_cwnd_limited;
+            sample.in_recovery = is_fast_recover;
+            if(newest.sent_us != 0) {
+                // Delivered over the longer of the send and ACK intervals, so neither a burst nor ACK compression inflates it
+                int64_t interval = std::max(newest.sent_us - newest.first_sent_us, delivered_us - newest.delivered_us);
+                if(interval > 0) {
+                    sample.delivery_rate = (delivered - newest.delivered) * 1e6 / interval;
                 }
             }
+            cc->on_ack(sample);
+        }
+        // update SND.WND by RCV.WND
+        last_wnd = win;
+        max_wnd = std::max(max_wnd, win);
+        SND_WND = std::min(win, cc->cwnd());
+        if(SND_WND != 0) {
+            wheel.cancel(persist_timer);
+        }
+        if(ack_pkg.type == ACK) {
+            // A pure ACK carries the credit of one stream, never taken back
+            TxStream& s = stream(ack_pkg.stream);
+            if(seq_lt(s.credit, ack_pkg.ssn)) {
+                s.credit = ack_pkg.ssn;
+            }
         }
-        SND_WND = uSND_WND;
-        // Congestion avoidance, congestion window size linear inc
-        if(CONG_WND >= ssthresh) {
-            ++CONG_WND;
+        if(swnd.empty() && (n_queued == 0)) {
+            // Nagle: everything acked, the short packets waiting go now
+            push_tails();
         }
+        send_pkgs_in_buf();
     }
 
-    void Sender::send_raw_packet(const RawPacket& pkg) {
-        // Probe peer's RCV.WND
-        while(SND_WND == 0) {
-            SND_WND = 1;
-            RawPacket probe(cur_seq_num, 0, 0, DATA);
-            swnd[probe.seq_num] = probe;
-            ++cur_seq_num;
-            send_pkgs_in_buf();
+    void Sender::update_RTT(uint32_t rtt_us) {
+        rto.update(rtt_us);
+        cc->on_rtt(rtt_us, get_now_us());
+#ifdef DEBUG
+        std::cout << "RTT=" << rtt_us << "us" << ",";
+        std::cout << "SRTT=" << (rto.srtt >> 3) << "us" << ",";
+        std::cout << "RTTVAR=" << (rto.rttvar >> 2) << "us" << ",";
+        std::cout << "RTO=" << rto.RTO_us << "us" << ",";
+        std::cout << "CWND=" << cc->cwnd() << std::endl;
+#endif
+    }
+
+    void Sender::on_timer() {
+        on_timeout();
+        send_pkgs_in_buf();
+    }
+
+    void Sender::on_timeout() {
+        // If the waiting time exceeds the upper limit of the timeout, the current end considers that the peer end is closed
+        if(rto.timeout_ms() > MAX_WAIT_TIME) {
+            throw std::runtime_error("Connection closed by peer.");
         }
-        // Add into SND window
-        if(swnd.find(pkg.seq_num) == swnd.end()) {
-            swnd[pkg.seq_num] = pkg;
-            ++cur_seq_num;
+        // Backoff
+        rto.backoff_factor *= 2;
+        if((rto.backoff_factor >= 4) && (mss > BASE_MSS)) {
+            // A black hole for our size more likely than the peer gone: cut new packets at the base and search again.
+            // Those already cut larger keep their size, only a path that shrank back takes them.
+            mss = BASE_MSS;
+            start_pmtud(max_mss);
         }
-        // Send pkgs in SND window
-        send_pkgs_in_buf();
+        // Timeout retransmition's congestion occurs
+        cc->on_timeout(SND_NXT - swnd.front_seq());
+        dupack_cnt = 0;
+        is_fast_recover = false;
+        SND_WND = std::min(SND_WND, cc->cwnd());
+        // Retransmit everything not SACKed, from the first unacked packet
+        mark_lost(swnd.front_seq(), SND_NXT);
     }
 
-    void Sender::send_SYN() {
-        send_raw_packet(RawPacket(cur_seq_num, 0, 0, SYN));
+    uint32_t Sender::on_sack(const RawPacket& ack_pkg, int64_t now_us, TxStamp& newest, uint32_t& n_delivered) {
+        uint32_t old_high_sack = high_sack;
+        if(ack_pkg.type != ACK) {
+            // SACK blocks only ride in pure ACKs, anything else carries its own payload
+            return old_high_sack;
+        }
+        const char* p = ack_pkg.payload();
+        for(int i = 0; i < ack_pkg.len / 8; ++i, p += 8) {
+            uint32_t start, end;
+            ::memcpy(&start, p, 4);
+            ::memcpy(&end, p + 4, 4);
+            start = ntohl(start);
+            end = ntohl(end);
+            if(seq_lt(start, swnd.front_seq())) {
+                start = swnd.front_seq();
+            }
+            if(seq_lt(SND_NXT, end)) {
+                end = SND_NXT;
+            }
+            for(uint32_t seq = start; seq_lt(seq, end); ++seq) {
+                SlotState st = swnd.state(seq);
+                if(st == SENT) {
+                    --pipe;
+                }
+                if((st == SENT) || (st == RETRANSMIT)) {
+                    swnd.set_state(seq, ACKED);
+                    on_delivered(swnd.at(seq).tx, now_us, newest);
+                    ++n_delivered;
+                }
+            }
+            if(seq_lt(high_sack, end)) {
+                high_sack = end;
+            }
+        }
+        return old_high_sack;
     }
 
-    void Sender::send_FIN() {
-        send_raw_packet(RawPacket(cur_seq_num, 0, 0, FIN));
+    void Sender::mark_lost(uint32_t from, uint32_t to) {
+        for(uint32_t seq = from; seq_lt(seq, to); ++seq) {
+            if(swnd.state(seq) == SENT) {
+                swnd.set_state(seq, RETRANSMIT);
+                --pipe;
+            }
+        }
+        if(seq_lt(from, RTX_NXT)) {
+            RTX_NXT = from;
+        }
     }
 
-    void Sender::send_RST() {
-        send_raw_packet(RawPacket(cur_seq_num, 0, 0, RST));
+    void Sender::send_raw_packet(TxPacket p) {
+        // Add into SND window, it leaves as soon as the window has room
+        p.pkg.seq_num = cur_seq_num;
+        swnd.put(cur_seq_num, p, QUEUED);
+        ++cur_seq_num;
+    }
+
+    void Sender::abandon_if_due(TxPacket& p, bool is_rtx, int64_t now_ms) {
+        bool is_due = ((p.expire_ms != 0) && (now_ms >= p.expire_ms)) || (is_rtx && (p.rtx_left == 0));
+        if(is_rtx && (p.rtx_left > 0)) {
+            --p.rtx_left;
+        }
+        if(!is_due) {
+            return ;
+        }
+        // Its SEQ and SSN still have to reach the receiver, or both would wait for it forever; the payload doesn't.
+        // MORE stays, so the receiver knows which message to drop.
+        p.pkg.type |= SKIP;
+        p.pkg.buf = PacketBuf();
+        p.pkg.len = 0;
+        p.pkg.off = 0;
+        p.expire_ms = 0;
+        p.rtx_left = -1;
+    }
+
+    TxStream& Sender::stream(uint8_t id) {
+        return streams.emplace(id, TxStream(id, init_credit)).first->second;
+    }
+
+    void Sender::set_init_credit(uint32_t n) {
+        init_credit = n;
+        for(auto& e : streams) {
+            if(seq_lt(e.second.credit, n)) {
+                e.second.credit = n;
+            }
+        }
+    }
+
+    void Sender::append(TxStream& s, const RawPacket& pkg, int64_t expire_ms, int rtx_left) {
+        s.q.push_back(TxPacket(pkg, expire_ms, rtx_left));
+        s.q.back().pkg.stream = s.id;
+        s.q.back().pkg.ssn = s.next_ssn++;
+        ++n_queued;
+    }
+
+    bool Sender::pull(bool past_credit) {
+        auto best = streams.end();
+        for(auto it = streams.begin(); it != streams.end(); ++it) {
+            const TxStream& s = it->second;
+            // Datagrams take no credit, the receiver hands them over as they come
+            if(s.q.empty() || (!past_credit && (s.id != DGRAM_STREAM) && !seq_lt(s.q.front().pkg.ssn, s.credit))) {
+                continue;
+            }
+            // Strict priority, then the first stream after the one served last
+            if((best == streams.end()) || (s.priority < best->second.priority)
+               || ((s.priority == best->second.priority)
+                   && (static_cast<uint8_t>(it->first - rr_last - 1) < static_cast<uint8_t>(best->first - rr_last - 1)))) {
+                best = it;
+            }
+        }
+        if(best == streams.end()) {
+            if(!is_fin_pending || (n_queued != 0)) {
+                return false;
+            }
+            // The piggybacked ACK covers everything received so far, so it also answers a FIN whose ACK was lost
+            is_fin_pending = false;
+            send_raw_packet(TxPacket(RawPacket(0, 0, 0, FIN), 0, -1));
+            return true;
+        }
+        send_raw_packet(best->second.q.front());
+        best->second.q.pop_front();
+        --n_queued;
+        rr_last = best->first;
+        return true;
+    }
+
+    void Sender::start_pmtud(uint16_t max_mss, uint16_t known_mss) {
+        this->max_mss = probe_ceil = max_mss;
+        mss = std::min(std::max(mss, known_mss), max_mss);
+        probe_mss = 0;
+        probe_cnt = 0;
+        wheel.cancel(probe_timer);
+        send_probe();
+    }
+
+    uint16_t Sender::next_probe() const {
+        // Common link MTUs, then the ceiling
+        static const uint16_t MTUS[] = {1500, 9000};
+        for(uint16_t mtu : MTUS) {
+            uint16_t size = std::min<uint16_t>(mtu - IP_UDP_SIZE - HEADER_SIZE, probe_ceil);
+            if(size > mss) {
+                return size;
+            }
+        }
+        return 0;
+    }
+
+    void Sender::send_probe() {
+        if(probe_mss == 0) {
+            probe_mss = next_probe();
+            probe_cnt = 0;
+        }
+        if(probe_mss == 0) {
+            // Search complete, a larger path may turn up later
+            wheel.schedule(probe_timer, get_now_ms() + PMTU_RAISE_MS);
+            return ;
+        }
+        // Padding only and out of the windows: a lost probe is just a size that didn't fit, never a retransmission
+        RawPacket pkg(probe_mss, 0, 0, PROBE);
+        pkg.buf = PacketPool::frames().alloc();
+        ::memset(pkg.buf.data(), 0, probe_mss);
+        pkg.len = probe_mss;
+        io.push(pkg, addr);
+        wheel.schedule(probe_timer, get_now_ms() + rto.timeout_ms());
+#ifdef DEBUG
+        std::cout << "Sent PMTU probe:" << probe_mss << std::endl;
+#endif
+    }
+
+    void Sender::on_probe_timer() {
+        if((probe_mss != 0) && (++probe_cnt >= MAX_PROBES)) {
+            // That size doesn't get through, nothing above it will either
+            probe_ceil = probe_mss - 1;
+            probe_mss = 0;
+            wheel.schedule(probe_timer, get_now_ms() + PMTU_RAISE_MS);
+            return ;
+        }
+        if(probe_mss == 0) {
+            // Raise timer: the path may have grown since
+            probe_ceil = max_mss;
+        }
+        send_probe();
     }
 
-    void Sender::send_DATA(const std::string& data) {
-        send_raw_packet(RawPacket(cur_seq_num, 0, 0, DATA, data));
+    void Sender::on_probe_ack(const RawPacket& pkg) {
+        if((probe_mss == 0) || (pkg.seq_num != probe_mss)) {
+            // Late echo of an earlier probe
+            return ;
+        }
+        // Confirmed, the next new packet is cut at the larger size
+        mss = probe_mss;
+        probe_mss = 0;
+        wheel.cancel(probe_timer);
+        send_probe();
     }
 
-//    void Sender::send_keepalive_probe() {
-//        send_raw_packet(RawPacket(swnd.begin()->first-1, 0, 0, DATA));
-//    }
+    void Sender::send_SYN(const SynOptions& o, uint32_t wnd) {
+        char opts[SYN_OPTIONS_SIZE];
+        size_t n = o.encode(opts);
+        send_raw_packet(TxPacket(RawPacket(0, 0, static_cast<uint16_t>(std::min<uint32_t>(wnd, UINT16_MAX)), SYN, opts, n), 0, -1));
+        send_pkgs_in_buf();
+    }
 
-    void Sender::send_all_in_buf() {
-        while(!swnd.empty()) {
+    void Sender::open_window(uint32_t wnd) {
+        last_wnd = wnd;
+        SND_WND = std::min(wnd, cc->cwnd());
+    }
+
+    void Sender::set_isn(uint32_t isn) {
+        cur_seq_num = SND_NXT = RTX_NXT = high_sack = recover = isn;
+        swnd.reset(isn);
+    }
+
+    void Sender::set_nodelay(bool on) {
+        is_nodelay = on;
+        if(is_nodelay) {
+            push_tails();
             send_pkgs_in_buf();
         }
     }
+
+    void Sender::push_tail(TxStream& s) {
+        if(s.tail.len == 0) {
+            return ;
+        }
+        append(s, s.tail, 0, -1);
+        s.tail = RawPacket();
+    }
+
+    void Sender::push_tails() {
+        for(auto& e : streams) {
+            push_tail(e.second);
+        }
+    }
+
+    void Sender::write(uint8_t id, const char* data, size_t n) {
+        TxStream& s = stream(id);
+        while(n > 0) {
+            if(!s.tail.buf) {
+                s.tail.buf = PacketPool::fit(mss).alloc();
+            }
+            // mss may have grown since the buffer was taken
+            size_t room = std::min<size_t>(mss, s.tail.buf.capacity()) - s.tail.len;
+            size_t k = std::min(n, room);
+            ::memcpy(s.tail.buf.data() + s.tail.len, data, k);
+            s.tail.len += k;
+            data += k;
+            n -= k;
+            if(s.tail.len >= std::min<size_t>(mss, s.tail.buf.capacity())) {
+                push_tail(s);
+            }
+        }
+        // Nagle: a short packet only goes while nothing is unacked, the rest wait to fill it
+        if(is_nodelay || (swnd.empty() && (n_queued == 0))) {
+            push_tail(s);
+        }
+        send_pkgs_in_buf();
+    }
+
+    void Sender::send_FIN() {
+        // Stream bytes still gathering go before it, and it goes after every stream
+        push_tails();
+        is_fin_pending = true;
+        send_pkgs_in_buf();
+    }
+
+    void Sender::send_RST() {
+        io.push(RawPacket(cur_seq_num, 0, 0, RST), addr);
+    }
+
+    void Sender::send_keepalive() {
+        RawPacket pkg(swnd.front_seq() - 1, 0, 0, DATA);
+        if(piggyback) {
+            piggyback(pkg);
+        }
+        io.push(pkg, addr);
+#ifdef DEBUG
+        std::cout << "Sent keepalive probe SEQ:" << pkg.seq_num << std::endl;
+#endif
+    }
+
+    void Sender::send_DATA(uint8_t id, const char* data, size_t n, int64_t lifetime_ms, int max_rtx) {
+        TxStream& s = stream(id);
+        int64_t expire_ms = (lifetime_ms > 0) ? get_now_ms() + lifetime_ms : 0;
+        push_tail(s);
+        // Every fragment but the last is flagged MORE, the receiver reassembles them in SSN order
+        size_t off = 0;
+        do {
+            size_t len = std::min<size_t>(n - off, mss);
+            append(s, RawPacket(0, 0, 0, (off + len < n) ? (DATA | MORE) : DATA, data + off, len), expire_ms, max_rtx);
+            off += len;
+        } while(off < n);
+        send_pkgs_in_buf();
+    }
 }
@@ -1,46 +1,169 @@
 #ifndef SENDER_H
 #define SENDER_H
 
-#include "defs.hpp"
+#include "io.hpp"
+#include "ring.hpp"
+#include "timer.hpp"
+#include "congestion.hpp"
+#include <map>
+#include <deque>
 
 namespace jrReliableUDP {
+    // What the connection had delivered when a packet last left, for delivery rate samples
+    struct TxStamp {
+        int64_t sent_us;    // 0 until sent
+        int64_t first_sent_us;  // Send time of the packet that opened the sampling interval
+        int64_t delivered_us;
+        uint64_t delivered;
+        bool is_app_limited;
+
+        TxStamp() : sent_us(0), first_sent_us(0), delivered_us(0), delivered(0), is_app_limited(false) {}
+    };
+
+    struct TxPacket {
+        RawPacket pkg;
+        TxStamp tx;
+        int64_t expire_ms;  // Abandoned instead of sent from then on, 0 never
+        int rtx_left;   // Retransmissions before it is abandoned, -1 for no limit
+
+        TxPacket() : expire_ms(0), rtx_left(-1) {}
+        TxPacket(const RawPacket& pkg, int64_t expire_ms, int rtx_left) : pkg(pkg), expire_ms(expire_ms), rtx_left(rtx_left) {}
+    };
+
+    // One ordered stream on the send side: numbered by SSN, its packets wait here until the scheduler gives them a SEQ
+    struct TxStream {
+        uint8_t id;
+        std::deque<TxPacket> q;
+        uint32_t next_ssn;
+        uint32_t credit;    // First SSN the peer has no room for
+        int priority;   // Lower goes first
+        RawPacket tail;     // Stream mode: written bytes gather here until they fill a packet, or Nagle lets a short one go
+
+        TxStream(uint8_t id, uint32_t credit) : id(id), next_ssn(0), credit(credit), priority(0) {}
+    };
+
+    // PACING_TXTIME stamps every datagram with its departure time and lets the fq qdisc hold it;
+    // PACING_USER releases them from a token bucket on the timer wheel
+    enum PacingMode {PACING_OFF, PACING_USER, PACING_TXTIME};
+
+    // Never blocks: packets are queued and sent as the window opens, ACKs and timeouts are fed in by the event loop
     class Sender {
     private:
-        int sockfd;
         sockaddr_in& addr;
         RTO& rto;
+        BatchIO& io;
         uint32_t cur_seq_num;
         int dupack_cnt; // Duplicate ACK counter
-        uint16_t SND_NXT;
-        uint16_t SND_WND;
-        std::map<uint32_t, RawPacket> swnd;
+        uint32_t SND_NXT;   // SEQ of the first packet never sent
+        uint32_t RTX_NXT;   // No RETRANSMIT slot before this SEQ
+        uint32_t SND_WND;
+        uint32_t max_wnd;   // Largest window the peer advertised, packets
+        uint32_t last_wnd;  // RCV.WND of the last ACK, the right edge of new data; one changing it is a window update, not a duplicate
+        uint8_t snd_wscale;     // The peer's, applies to every window but the one in its SYN
+        uint32_t pipe;  // Packets in flight: SENT and neither acked, SACKed nor marked lost
+        uint32_t high_sack;     // One past the highest SACKed SEQ
+        uint32_t recover;   // SND.NXT when fast recovery began
+        Ring<TxPacket> swnd;    // From SND.UNA to the last queued packet
+        TimerWheel& wheel;
+        Timer rtx_timer;    // Retransmission timeout of the oldest outstanding packet
+        Timer persist_timer;    // Window probes while the peer advertises a zero window
+        int64_t persist_ms;     // Current probe interval, doubles up to PERSIST_MAX
+        // Pacing at the controller's rate, between the window and the socket
+        PacingMode pacing;
+        Timer pace_timer;   // Token bucket refill
+        double tokens;
+        int64_t refill_us;
+        int64_t next_tx_ns;     // Departure time of the next datagram with SO_TXTIME
+        std::function<void(RawPacket&)> piggyback;  // Fills in the receive side's ACK on every transmission
+        // Streams: strict priority between levels, round robin within one, each held to the credit its receiver gave
+        std::map<uint8_t, TxStream> streams;
+        uint8_t rr_last;    // Stream served last
+        uint32_t n_queued;  // Packets waiting in streams, not in swnd yet
+        uint32_t init_credit;   // Every stream's before the peer says otherwise
+        bool is_fin_pending;    // The FIN follows once every stream drained
+        bool is_nodelay;
+        // DPLPMTUD, RFC 8899: new packets are cut at mss, probes find out whether a larger one gets through
+        uint16_t mss;
+        uint16_t max_mss;   // Negotiated, the search never goes above
+        uint16_t probe_ceil;    // Largest size not known to fail
+        uint16_t probe_mss;     // Size of the probe in flight, 0 if none
+        int probe_cnt;  // Its lost attempts
+        Timer probe_timer;  // Probe loss, or PMTU_RAISE_MS after the search completed
         // Congress arguments
-        uint16_t CONG_WND;
-        uint16_t ssthresh;
+        std::unique_ptr<CongestionControl> cc;
         bool is_fast_recover;
+        bool is_cwnd_limited;   // The last send stopped at the congestion window
+        // Delivery rate sampling, per draft-cheng-iccrg-delivery-rate-estimation
+        uint64_t delivered;
+        int64_t delivered_us;
+        int64_t first_sent_us;
+        uint64_t app_limited;   // Non-zero until the packets sent while short of data are delivered
+        int64_t last_tx_us;     // Last transmission of a sequenced packet, 0 if none
         const int64_t MAX_WAIT_TIME = 10000;
 
     private:
         uint32_t init_seq_num() const;
-        uint16_t init_WND() const;
-        uint16_t init_ssthresh() const;
-        void set_timeout();
+        void restart_timer();
+        void on_persist();
+        uint32_t usable_WND() const;
+        void stamp(uint32_t seq, int64_t now_us);
+        bool pace(int64_t now_us, uint64_t& txtime_ns);
         void send_pkgs_in_buf();
-        void wait_ack();
-        void send_raw_packet(const RawPacket& pkg);
+        void on_delivered(const TxStamp& tx, int64_t now_us, TxStamp& newest);
+        void update_RTT(uint32_t rtt_us);
+        void on_timeout();
+        uint32_t on_sack(const RawPacket& ack_pkg, int64_t now_us, TxStamp& newest, uint32_t& n_delivered);
+        void mark_lost(uint32_t from, uint32_t to);
+        void send_raw_packet(TxPacket p);   // Into swnd at the next SEQ
+        TxStream& stream(uint8_t id);
+        void append(TxStream& s, const RawPacket& pkg, int64_t expire_ms, int rtx_left);   // At the stream's next SSN
+        void abandon_if_due(TxPacket& p, bool is_rtx, int64_t now_ms);
+        bool pull(bool past_credit);    // Move the next packet the scheduler picks into swnd, false if none may go
+        void push_tail(TxStream& s);
+        void push_tails();
+        uint16_t next_probe() const;
+        void send_probe();
+        void on_probe_timer();
 
     public:
-        Sender(int sockfd, sockaddr_in& addr, RTO& rto);
-        Sender(int sockfd, sockaddr_in& addr, RTO& rto, const Sender& s);
-        Sender(int sockfd, sockaddr_in& addr, RTO& rto, const Sender& s, uint16_t SND_WND);
-        void set_WND() { SND_WND = init_WND(); }
-        void reset_WND() { SND_WND = 1; }
-        void send_SYN();
+        Sender(sockaddr_in& addr, RTO& rto, BatchIO& io, TimerWheel& wheel);
+        void set_wscale(uint8_t s) { snd_wscale = s; }
+        void reset_WND() { SND_WND = last_wnd = 1; }
+        void open_window(uint32_t wnd);     // Before any ACK: send up to wnd packets, a window the peer offered before
+        uint32_t peer_window() const { return max_wnd; }
+        // Every queued packet went out at least once
+        bool is_all_sent() const { return (SND_NXT == swnd.end_seq()) && (n_queued == 0) && !is_fin_pending; }
+        bool is_all_acked() const { return swnd.empty() && (n_queued == 0) && !is_fin_pending; }
+        uint32_t backlog() const { return swnd.size() + n_queued; }     // Packets queued or in flight
+        uint32_t una() const { return swnd.front_seq(); }
+        void set_timer_handler(std::function<void()> handler) { rtx_timer.set_handler(handler); }
+        void set_piggyback(std::function<void(RawPacket&)> fill) { piggyback = fill; }
+        void stop_timers();
+        void set_congestion(CongestionAlgorithm algo) { cc = CongestionControl::create(algo); }
+        const CongestionControl& congestion() const { return *cc; }
+        void set_pacing(PacingMode mode) { pacing = mode; }
+        void set_nodelay(bool on);  // Send short stream packets at once instead of while nothing is unacked
+        void set_priority(uint8_t id, int priority) { stream(id).priority = priority; }
+        void set_init_credit(uint32_t n);   // Announced in the peer's SYN
+        void on_ack(const RawPacket& ack_pkg);
+        void on_timer();    // Retransmission timeout, throws once the peer is considered gone
+        uint16_t get_mss() const { return mss; }
+        // Search up to max_mss, the smaller of both ends', from BASE_MSS or from known_mss if that got through before
+        void start_pmtud(uint16_t max_mss, uint16_t known_mss = 0);
+        void on_probe_ack(const RawPacket& pkg);
+        // Announces the largest payload we take, our window scale, the receive window it opens with and each stream's credit
+        void send_SYN(const SynOptions& o, uint32_t wnd);
+        void set_isn(uint32_t isn);     // Before anything is sent: first SEQ, past a SYN already acked
         void send_FIN();
-        void send_RST();
-        void send_DATA(const std::string& data);
-//        void send_keepalive_probe();
-        void send_all_in_buf();
+        void send_RST();    // Not sequenced, nothing waits for its ACK
+        // Empty data packet one below SND.UNA: already acked, the peer only answers with an ACK. Out of the windows
+        // and never retransmitted, unanswered it is just sent again later.
+        void send_keepalive();
+        int64_t last_sent_ms() const { return last_tx_us / 1000; }
+        // One message, as mss sized fragments if it is larger. Partially reliable with a lifetime (0 for none) or a
+        // retransmission limit (-1 for none): a fragment due is sent as an empty SKIP in its place.
+        void send_DATA(uint8_t id, const char* data, size_t n, int64_t lifetime_ms = 0, int max_rtx = -1);
+        void write(uint8_t id, const char* data, size_t n);     // Stream bytes, coalesced into mss sized packets
     };
 }
 
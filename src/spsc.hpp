@@ -0,0 +1,115 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+namespace jrReliableUDP {
+    // Bounded lock-free ring between exactly one producer thread and one consumer thread. Items are moved in and out,
+    // so handles (PacketBuf, std::string) cross threads without copying what they point to.
+    template<typename T>
+    class SpscRing {
+    private:
+        std::vector<T> slots;
+        size_t mask;
+        // Each index is written by one side only; apart so the two sides don't share a cache line
+        char pad0[64];
+        std::atomic<size_t> head;   // Next to pop, the consumer's
+        char pad1[64];
+        std::atomic<size_t> tail;   // Next to push, the producer's
+        char pad2[64];
+
+    public:
+        explicit SpscRing(size_t capacity) : mask(0), head(0), tail(0) {
+            size_t cap = 1;
+            while(cap < capacity) {
+                cap <<= 1;
+            }
+            slots.resize(cap);
+            mask = cap - 1;
+        }
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        // Producer: false when full, item is left alone then
+        bool push(T& item) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if(t - head.load(std::memory_order_acquire) > mask) {
+                return false;
+            }
+            slots[t & mask] = std::move(item);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer: false when empty
+        bool pop(T& item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = std::move(slots[h & mask]);
+            slots[h & mask] = T();  // Drop the moved-from handle now, not when the slot comes round again
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Exact from either side for its own end, a snapshot of the other's
+        bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+        bool full() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire) > mask; }
+    };
+
+    // One thread sleeps on an eventfd until a condition holds, others notify it. Notifying costs an atomic exchange
+    // unless the sleeper is actually waiting, so a burst of notifications becomes a single write. A single write
+    // wakes a single sleeper: two threads waiting on one Notifier could both miss it, each needs its own.
+    class Notifier {
+    private:
+        int efd;
+        std::atomic<bool> is_waiting;
+
+    public:
+        Notifier() : efd(::eventfd(0, EFD_CLOEXEC)), is_waiting(false) {
+            if(-1 == efd) {
+                throw std::runtime_error("Eventfd create failed");
+            }
+        }
+        Notifier(const Notifier&) = delete;
+        Notifier& operator=(const Notifier&) = delete;
+        ~Notifier() { ::close(efd); }
+
+        void notify() {
+            // Whatever the condition reads was published before this; with the fence in wait_until, either the
+            // sleeper sees it or we see the sleeper
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(is_waiting.exchange(false)) {
+                uint64_t one = 1;
+                ssize_t ret = ::write(efd, &one, sizeof(one));
+                (void)ret;
+            }
+        }
+
+        template<typename Pred>
+        void wait_until(Pred pred) {
+            while(!pred()) {
+                // Announce the sleep, then look again: a notify in between either is seen here or writes the eventfd
+                is_waiting.store(true);
+                // Or the condition's acquire loads could be done before the store is visible
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(pred()) {
+                    is_waiting.store(false);
+                    return ;
+                }
+                uint64_t n;
+                ssize_t ret = ::read(efd, &n, sizeof(n));
+                (void)ret;
+            }
+        }
+    };
+}
+
+#endif
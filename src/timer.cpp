@@ -0,0 +1,181 @@
+#include "timer.hpp"
+#include <algorithm>
+
+namespace jrReliableUDP {
+    Timer::~Timer() {
+        if(wheel) {
+            wheel->cancel(*this);
+        }
+    }
+
+    TimerWheel::TimerWheel(int64_t now) : cur(now), n_timers(0) {
+        std::fill(occupied, occupied + LEVELS, 0);
+    }
+
+    TimerWheel::~TimerWheel() {
+        // Outliving timers must not point back into a dead wheel
+        for(int level = 0; level <= LEVELS + 1; ++level) {
+            for(int slot = 0; slot < ((level >= LEVELS) ? 1 : SLOTS); ++slot) {
+                Timer& head = (level == LEVELS) ? overflow : ((level > LEVELS) ? expired : slots[level][slot]);
+                while(head.next != &head) {
+                    Timer* t = head.next;
+                    unlink(*t);
+                    t->wheel = nullptr;
+                }
+            }
+        }
+    }
+
+    void TimerWheel::link(Timer& head, Timer& t) {
+        t.next = &head;
+        t.prev = head.prev;
+        head.prev->next = &t;
+        head.prev = &t;
+    }
+
+    void TimerWheel::unlink(Timer& t) {
+        t.prev->next = t.next;
+        t.next->prev = t.prev;
+        t.prev = t.next = &t;
+    }
+
+    void TimerWheel::splice(Timer& from, Timer& to) {
+        if(from.next != &from) {
+            to.next = from.next;
+            to.prev = from.prev;
+            to.next->prev = &to;
+            to.prev->next = &to;
+            from.next = from.prev = &from;
+        }
+    }
+
+    void TimerWheel::place(Timer& t, int64_t tick) {
+        // The lowest level whose slot span still covers tick: above it tick and cur share every bit
+        uint64_t diff = static_cast<uint64_t>(tick ^ cur);
+        for(int level = 0; level < LEVELS; ++level) {
+            if((diff >> (BITS * (level + 1))) == 0) {
+                t.level = level;
+                t.slot = static_cast<int>((tick >> (BITS * level)) & (SLOTS - 1));
+                link(slots[level][t.slot], t);
+                occupied[level] |= (1ull << t.slot);
+                return ;
+            }
+        }
+        t.level = LEVELS;
+        t.slot = 0;
+        link(overflow, t);
+    }
+
+    void TimerWheel::schedule(Timer& t, int64_t expiry) {
+        if(t.wheel) {
+            cancel(t);
+        }
+        t.expiry = expiry;
+        t.wheel = this;
+        ++n_timers;
+        if(expiry <= cur) {
+            t.level = LEVELS + 1;
+            t.slot = 0;
+            link(expired, t);
+        } else {
+            place(t, expiry);
+        }
+    }
+
+    void TimerWheel::cancel(Timer& t) {
+        if(t.wheel != this) {
+            return ;
+        }
+        Timer& head = head_of(t);
+        unlink(t);
+        if((t.level < LEVELS) && (head.next == &head)) {
+            occupied[t.level] &= ~(1ull << t.slot);
+        }
+        t.wheel = nullptr;
+        --n_timers;
+    }
+
+    int64_t TimerWheel::next_event(const Timer** head) const {
+        for(int level = 0; level < LEVELS; ++level) {
+            int idx = static_cast<int>((cur >> (BITS * level)) & (SLOTS - 1));
+            // Only slots after cur's are in use on each level
+            uint64_t mask = occupied[level] & ~((2ull << idx) - 1);
+            if(mask) {
+                int slot = __builtin_ctzll(mask);
+                if(head) {
+                    *head = &slots[level][slot];
+                }
+                int64_t block = (cur >> (BITS * (level + 1))) << (BITS * (level + 1));
+                return block | (static_cast<int64_t>(slot) << (BITS * level));
+            }
+        }
+        if(overflow.next != &overflow) {
+            if(head) {
+                *head = &overflow;
+            }
+            return ((cur >> (BITS * LEVELS)) + 1) << (BITS * LEVELS);
+        }
+        return -1;
+    }
+
+    int64_t TimerWheel::next_deadline() const {
+        const Timer* head = &expired;
+        if((expired.next == &expired) && (next_event(&head) < 0)) {
+            return 0;
+        }
+        // Everything in the earliest slot is due before anything elsewhere; a coarse slot spans many ticks
+        int64_t earliest = head->next->expiry;
+        for(const Timer* p = head->next; p != head; p = p->next) {
+            earliest = std::min(earliest, p->expiry);
+        }
+        return earliest;
+    }
+
+    void TimerWheel::cascade(Timer& head) {
+        // Detach the list first: overflow timers may land in overflow again
+        Timer pending;
+        splice(head, pending);
+        while(pending.next != &pending) {
+            Timer* t = pending.next;
+            unlink(*t);
+            place(*t, t->expiry);
+        }
+    }
+
+    void TimerWheel::fire(Timer& head) {
+        // Handlers may arm or cancel any timer, including the rest of this list
+        while(head.next != &head) {
+            Timer* p = head.next;
+            cancel(*p);
+            if(p->handler) {
+                p->handler();
+            }
+        }
+    }
+
+    void TimerWheel::advance(int64_t now) {
+        if(expired.next != &expired) {
+            // Only what was already due on entry, re-arming from a handler waits for the next round
+            Timer due;
+            splice(expired, due);
+            fire(due);
+        }
+        int64_t t;
+        while(((t = next_event(nullptr)) >= 0) && (t <= now)) {
+            cur = t;
+            // A boundary of one level is a boundary of every level below: redistribute from the top down
+            if((cur & ((1ll << (BITS * LEVELS)) - 1)) == 0) {
+                cascade(overflow);
+            }
+            for(int level = LEVELS - 1; level > 0; --level) {
+                if((cur & ((1ll << (BITS * level)) - 1)) == 0) {
+                    int idx = static_cast<int>((cur >> (BITS * level)) & (SLOTS - 1));
+                    occupied[level] &= ~(1ull << idx);
+                    cascade(slots[level][idx]);
+                }
+            }
+            fire(slots[0][cur & (SLOTS - 1)]);
+        }
+        cur = std::max(cur, now);
+    }
+}
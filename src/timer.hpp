@@ -0,0 +1,73 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace jrReliableUDP {
+    class TimerWheel;
+
+    // Intrusive timer node, owned by whoever needs the timeout; unlinks itself when destroyed
+    class Timer {
+        friend class TimerWheel;
+
+    private:
+        Timer* prev;
+        Timer* next;
+        TimerWheel* wheel;  // Non-null while armed
+        int level;  // Where it is linked: slots[level][slot], the overflow list at LEVELS, the expired list above
+        int slot;
+        int64_t expiry;
+        std::function<void()> handler;
+
+    public:
+        Timer() : prev(this), next(this), wheel(nullptr), level(0), slot(0), expiry(0) {}
+        explicit Timer(std::function<void()> handler) : Timer() { this->handler = handler; }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+        ~Timer();
+        void set_handler(std::function<void()> h) { handler = h; }
+        bool is_armed() const { return wheel != nullptr; }
+        int64_t deadline() const { return expiry; }
+    };
+
+    // Hierarchical timing wheel with 1 ms ticks: LEVELS levels of SLOTS slots, each level SLOTS times coarser.
+    // Arming and cancelling are O(1); the loop asks for the next deadline and sleeps exactly that long.
+    class TimerWheel {
+    private:
+        static const int BITS = 6;
+        static const int SLOTS = 1 << BITS;
+        static const int LEVELS = 4;    // 2^24 ms, about 4.6 hours, later timers wait in the overflow list
+
+        int64_t cur;    // Every timer due at or before this tick has fired
+        Timer slots[LEVELS][SLOTS];     // List heads
+        uint64_t occupied[LEVELS];  // Bit i set when slots[level][i] is non-empty
+        Timer overflow;
+        Timer expired;  // Armed with a deadline already passed, fired by the next advance
+        size_t n_timers;
+
+    private:
+        static void link(Timer& head, Timer& t);
+        static void unlink(Timer& t);
+        static void splice(Timer& from, Timer& to);     // Move the whole list, to must be empty
+        void place(Timer& t, int64_t tick);
+        int64_t next_event(const Timer** head) const;   // Earliest tick after cur where a slot fires or cascades, -1 if none
+        void cascade(Timer& head);
+        Timer& head_of(Timer& t) { return (t.level == LEVELS) ? overflow : ((t.level > LEVELS) ? expired : slots[t.level][t.slot]); }
+        void fire(Timer& head);
+
+    public:
+        explicit TimerWheel(int64_t now);
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+        ~TimerWheel();
+        size_t size() const { return n_timers; }
+        void schedule(Timer& t, int64_t expiry);    // (Re)arm t to fire at expiry
+        void cancel(Timer& t);
+        int64_t next_deadline() const;  // Earliest expiry, 0 if nothing is armed
+        void advance(int64_t now);  // Fire every timer due at or before now
+    };
+}
+
+#endif
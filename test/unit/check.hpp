@@ -0,0 +1,48 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "../../src/jrudp.hpp"
+#include <future>
+#include <thread>
+#include <iostream>
+
+// The protocol's DEBUG trace goes to stdout, failures to stderr
+#define CHECK(cond) do { \
+        if(!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+            std::exit(1); \
+        } \
+    } while(0)
+
+#define CHECK_THROWS(expr) do { \
+        bool is_thrown = false; \
+        try { \
+            expr; \
+        } catch(const std::runtime_error&) { \
+            is_thrown = true; \
+        } \
+        CHECK(is_thrown && #expr); \
+    } while(0)
+
+namespace jrReliableUDP {
+    // Server side of a loopback test on its own thread. The client connects once the port listens, so its first
+    // SYN isn't lost to a port nobody serves yet.
+    class Peer {
+    private:
+        std::promise<void> ready;
+        std::thread thread;
+
+    public:
+        template<typename F>
+        explicit Peer(F f) {
+            std::future<void> is_ready = ready.get_future();
+            thread = std::thread([this, f]() { f(ready); });
+            is_ready.wait();
+        }
+        Peer(const Peer&) = delete;
+        Peer& operator=(const Peer&) = delete;
+        ~Peer() { thread.join(); }
+    };
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "check.hpp"
+#include <mutex>
+#include <atomic>
+#include <poll.h>
+
+namespace jrReliableUDP {
+    // UDP relay between one client and a server port on loopback, dropping whatever its rule picks: a lossy path
+    // the test controls packet by packet. The client connects to the relay's port; the server sees the relay.
+    class Relay {
+    public:
+        // A datagram as the rule sees it, read straight from the header
+        struct Datagram {
+            uint32_t seq;
+            uint32_t ack;
+            uint16_t wnd;   // As on the wire, before any scaling
+            uint32_t tsval;
+            uint32_t tsecr;
+            uint8_t type;
+            uint8_t stream;
+            uint16_t len;   // Payload
+            size_t size;    // Whole datagram
+            bool to_server;
+            bool is_dropped;
+        };
+        using Rule = std::function<bool(const Datagram&)>;     // true drops it; called on the relay's thread only
+
+    private:
+        int fd;
+        sockaddr_in server;
+        sockaddr_in client;
+        bool has_client;
+        Rule rule;
+        std::atomic<bool> is_stopping;
+        mutable std::mutex mtx;
+        std::vector<Datagram> history;
+        std::thread thread;
+
+    private:
+        void run() {
+            std::vector<char> buf(65536);
+            while(!is_stopping.load()) {
+                pollfd p = {fd, POLLIN, 0};
+                if(::poll(&p, 1, 5) != 1) {
+                    continue;
+                }
+                sockaddr_in from;
+                socklen_t len = sizeof(from);
+                ssize_t n = ::recvfrom(fd, buf.data(), buf.size(), 0, reinterpret_cast<sockaddr*>(&from), &len);
+                if(n < HEADER_SIZE) {
+                    continue;
+                }
+                Datagram d;
+                uint32_t seq, ack, tsval, tsecr;
+                uint16_t wnd, plen;
+                ::memcpy(&seq, buf.data(), 4);
+                ::memcpy(&ack, buf.data() + 4, 4);
+                ::memcpy(&wnd, buf.data() + 8, 2);
+                ::memcpy(&tsval, buf.data() + 12, 4);
+                ::memcpy(&tsecr, buf.data() + 16, 4);
+                ::memcpy(&plen, buf.data() + 24, 2);
+                d.seq = ntohl(seq);
+                d.ack = ntohl(ack);
+                d.wnd = ntohs(wnd);
+                d.tsval = ntohl(tsval);
+                d.tsecr = ntohl(tsecr);
+                d.type = static_cast<uint8_t>(buf[10]);
+                d.stream = static_cast<uint8_t>(buf[11]);
+                d.len = ntohs(plen);
+                d.size = n;
+                d.to_server = (from.sin_port != server.sin_port);
+                if(d.to_server) {
+                    client = from;
+                    has_client = true;
+                } else if(!has_client) {
+                    continue;
+                }
+                d.is_dropped = rule && rule(d);
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    history.push_back(d);
+                }
+                if(!d.is_dropped) {
+                    const sockaddr_in& to = d.to_server ? server : client;
+                    ::sendto(fd, buf.data(), n, 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+                }
+            }
+        }
+
+    public:
+        Relay(uint16_t port, uint16_t server_port, Rule rule = nullptr)
+            : fd(::socket(AF_INET, SOCK_DGRAM, 0)), has_client(false), rule(rule), is_stopping(false) {
+            CHECK(fd != -1);
+            sockaddr_in addr;
+            ::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            CHECK(0 == ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+            server = addr;
+            server.sin_port = htons(server_port);
+            thread = std::thread([this]() { run(); });
+        }
+        Relay(const Relay&) = delete;
+        Relay& operator=(const Relay&) = delete;
+        ~Relay() {
+            stop();
+            ::close(fd);
+        }
+        // Not before the server is done: a server still closing would resend its FIN into nothing until it gave up
+        void stop() {
+            is_stopping.store(true);
+            if(thread.joinable()) {
+                thread.join();
+            }
+        }
+        // Everything seen so far, dropped or not, in arrival order
+        std::vector<Datagram> log() const {
+            std::lock_guard<std::mutex> lock(mtx);
+            return history;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef SENDER_RIG_H
+#define SENDER_RIG_H
+
+#include "check.hpp"
+#include <poll.h>
+
+namespace jrReliableUDP {
+    // A Sender on its own, without a connection: what it sends lands on a plain UDP socket, where the test reads
+    // it, and the ACKs are whatever the test feeds it
+    class SenderRig {
+    public:
+        // A datagram as it arrived, read straight from the header
+        struct Arrival {
+            uint32_t seq;
+            uint8_t type;
+            uint32_t ts_val;
+            uint16_t len;
+            int64_t at_us;
+        };
+
+    private:
+        int rx;
+        int tx;
+        sockaddr_in addr;
+
+    public:
+        BatchIO io;
+        TimerWheel wheel;
+        RTO rto;
+        Sender sender;
+        std::vector<Arrival> arrivals;
+
+    private:
+        static int open_udp() {
+            int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            CHECK(fd != -1);
+            sockaddr_in a;
+            ::memset(&a, 0, sizeof(a));
+            a.sin_family = AF_INET;
+            a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            CHECK(0 == ::bind(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)));
+            return fd;
+        }
+        static sockaddr_in local_addr(int fd) {
+            sockaddr_in a;
+            socklen_t len = sizeof(a);
+            CHECK(0 == ::getsockname(fd, reinterpret_cast<sockaddr*>(&a), &len));
+            return a;
+        }
+
+    public:
+        SenderRig()
+            : rx(open_udp()), tx(open_udp()), addr(local_addr(rx)), io(tx), wheel(get_now_ms()),
+              sender(addr, rto, io, wheel) {
+        }
+        SenderRig(const SenderRig&) = delete;
+        SenderRig& operator=(const SenderRig&) = delete;
+        ~SenderRig() {
+            sender.stop_timers();
+            ::close(rx);
+            ::close(tx);
+        }
+        // Send what is queued, fire due timers and collect what arrives, for ms
+        void run_for(int64_t ms) {
+            int64_t end = get_now_ms() + ms;
+            while(true) {
+                io.flush();
+                int64_t now = get_now_ms();
+                wheel.advance(now);
+                io.flush();
+                char buf[65536];
+                ssize_t n;
+                while((n = ::recv(rx, buf, sizeof(buf), 0)) >= HEADER_SIZE) {
+                    Arrival a;
+                    uint32_t seq, ts_val;
+                    uint16_t len;
+                    ::memcpy(&seq, buf, 4);
+                    ::memcpy(&ts_val, buf + 12, 4);
+                    ::memcpy(&len, buf + 24, 2);
+                    a.seq = ntohl(seq);
+                    a.type = static_cast<uint8_t>(buf[10]);
+                    a.ts_val = ntohl(ts_val);
+                    a.len = ntohs(len);
+                    a.at_us = get_now_us();
+                    arrivals.push_back(a);
+                }
+                if(now >= end) {
+                    return ;
+                }
+                pollfd p = {rx, POLLIN, 0};
+                ::poll(&p, 1, 1);
+            }
+        }
+        // Data packets seen with this SEQ
+        int count(uint32_t seq) const {
+            int n = 0;
+            for(const Arrival& a : arrivals) {
+                n += (IS_DATA(a.type) && (a.seq == seq)) ? 1 : 0;
+            }
+            return n;
+        }
+        // A pure ACK from the peer; ts_ecr 0 carries no RTT sample
+        void ack(uint32_t ack_num, uint16_t wnd, uint32_t ts_ecr = 0, const std::string& sack = "") {
+            RawPacket pkg(0, ack_num, wnd, ACK, sack);
+            pkg.ts_ecr = ts_ecr;
+            sender.on_ack(pkg);
+        }
+        void send(size_t n_pkgs) {
+            for(size_t i = 0; i < n_pkgs; ++i) {
+                std::string m = "Package" + std::to_string(i);
+                sender.send_DATA(0, m.data(), m.size());
+            }
+        }
+        // SEQ 0 sent and acked with wnd, as after a handshake: the window is open and data starts at SEQ 1
+        void open(uint16_t wnd) {
+            send(1);
+            run_for(1);
+            ack(1, wnd);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "sender_rig.hpp"
+#include "relay.hpp"
+
+using namespace jrReliableUDP;
+
+static std::string sack_block(uint32_t start, uint32_t end) {
+    uint32_t b[2] = {htonl(start), htonl(end)};
+    return std::string(reinterpret_cast<const char*>(b), sizeof(b));
+}
+
+// Pure ACKs the server sent while receiving n packets, under its ACK policy
+static size_t count_acks(uint16_t port, uint16_t relay_port, int n, uint32_t every, int64_t delay_ms) {
+    Relay relay(relay_port, port);
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(port);
+        l.set_ack_policy(every, delay_ms);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < n; ++i) {
+            CHECK(s.recv_pkg() == "Package" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", relay_port);
+    for(int i = 0; i < n; ++i) {
+        c.send_pkg("Package" + std::to_string(i));
+    }
+    c.disconnect();
+    size_t acks = 0;
+    for(const Relay::Datagram& d : relay.log()) {
+        acks += (!d.to_server && (d.type == ACK)) ? 1 : 0;
+    }
+    return acks;
+}
+
+int main() {
+    // RFC 5681: pure ACKs of SND.UNA that only move the window are window updates, not duplicates. SND.UNA is
+    // lost, everything after it SACKed, so the pipe leaves room for its retransmission.
+    {
+        SenderRig rig;
+        rig.open(20);
+        rig.send(10);
+        rig.run_for(5);
+        CHECK(rig.count(1) == 1);
+        rig.ack(1, 20, 0, sack_block(2, 11));   // New SACK information, the first duplicate
+        for(uint16_t w = 19; w >= 17; --w) {
+            rig.ack(1, w, 0, sack_block(2, 11));
+        }
+        rig.run_for(5);
+        CHECK(rig.count(1) == 1);
+        // Two more with the window unchanged make three
+        rig.ack(1, 17, 0, sack_block(2, 11));
+        rig.ack(1, 17, 0, sack_block(2, 11));
+        rig.run_for(5);
+        CHECK(rig.count(1) == 2);
+        CHECK(rig.count(2) == 1);
+    }
+    // RFC 6675: one that SACKs something new counts whatever its window
+    {
+        SenderRig rig;
+        rig.open(20);
+        rig.send(10);
+        rig.run_for(5);
+        rig.ack(1, 19, 0, sack_block(3, 9));
+        rig.ack(1, 18, 0, sack_block(3, 10));
+        rig.run_for(5);
+        CHECK(rig.count(1) == 1);
+        rig.ack(1, 17, 0, sack_block(3, 11));
+        rig.run_for(5);
+        CHECK(rig.count(1) == 2);
+        CHECK(rig.count(2) == 2);   // The hole below the highest SACK is resent too, nothing SACKed is
+        CHECK((rig.count(3) == 1) && (rig.count(10) == 1));
+    }
+
+    // Delayed ACKs: by default one per ACK_EVERY in-order packets, with (1, 0) one for each
+    const int N = 1000;
+    size_t delayed = count_acks(19140, 19141, N, ACK_EVERY, ACK_DELAY_MS);
+    size_t immediate = count_acks(19142, 19143, N, 1, 0);
+    CHECK(delayed <= N / ACK_EVERY + N / 10);
+    CHECK(immediate >= N * 9 / 10);
+    return 0;
+}
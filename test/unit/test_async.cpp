@@ -0,0 +1,112 @@
+#include "check.hpp"
+#include <list>
+
+using namespace jrReliableUDP;
+
+// Echo server and clients all on one thread and one loop: handshakes, echoes and closes of every connection
+// proceed together, and no handler runs inside the call that started it
+int main() {
+    const uint16_t PORT = 19210;
+    const int N_CONNS = 50;
+    const int N = 20;
+    std::shared_ptr<Reactor> r = std::make_shared<Reactor>();
+    bool is_calling = false;    // Set around every async call; a handler seeing it ran inline
+    auto call = [&](const std::function<void()>& f) {
+        is_calling = true;
+        f();
+        is_calling = false;
+    };
+    std::list<Socket> socks;   // Handlers refer to their socket, which must outlive them
+    int n_accepted = 0;
+    int n_server_closed = 0;
+    int n_client_closed = 0;
+
+    Socket l(r);
+    l.bind(PORT);
+    l.listen();
+    std::function<void(Socket&)> echo = [&](Socket& s) {
+        call([&]() {
+            s.async_recv([&](const std::string& data, const std::string& error) {
+                CHECK(!is_calling && error.empty());
+                if(data.empty()) {
+                    call([&]() {
+                        s.async_disconnect([&](const std::string& error) {
+                            CHECK(!is_calling && error.empty());
+                            ++n_server_closed;
+                        });
+                    });
+                    return ;
+                }
+                call([&]() {
+                    s.async_send(data, [&](const std::string& error) { CHECK(!is_calling && error.empty()); });
+                });
+                echo(s);
+            });
+        });
+    };
+    std::function<void()> accept_next = [&]() {
+        call([&]() {
+            l.async_accept([&](Socket s, const std::string& error) {
+                CHECK(!is_calling && error.empty());
+                socks.push_back(std::move(s));
+                echo(socks.back());
+                if(++n_accepted < N_CONNS) {
+                    accept_next();
+                }
+            });
+        });
+    };
+    accept_next();
+
+    // Each client sends its next message once the previous one came back
+    std::function<void(Socket&, int, int)> ping = [&](Socket& c, int id, int k) {
+        if(k == N) {
+            call([&]() {
+                c.async_disconnect([&](const std::string& error) {
+                    CHECK(!is_calling && error.empty());
+                    ++n_client_closed;
+                });
+            });
+            return ;
+        }
+        std::string m = std::to_string(id) + ":" + std::to_string(k);
+        call([&]() {
+            c.async_send(m, [&](const std::string& error) { CHECK(!is_calling && error.empty()); });
+            c.async_recv([&, id, k, m](const std::string& data, const std::string& error) {
+                CHECK(!is_calling && error.empty() && (data == m));
+                ping(c, id, k + 1);
+            });
+        });
+    };
+    for(int i = 0; i < N_CONNS; ++i) {
+        socks.push_back(Socket(r));
+        Socket& c = socks.back();
+        call([&]() {
+            c.async_connect("127.0.0.1", PORT, [&, i](const std::string& error) {
+                CHECK(!is_calling && error.empty());
+                ping(c, i, 0);
+            });
+        });
+    }
+
+    int64_t deadline = get_now_ms() + 30000;
+    while(((n_client_closed < N_CONNS) || (n_server_closed < N_CONNS)) && (get_now_ms() < deadline)) {
+        r->run_once(10);
+    }
+    CHECK(n_accepted == N_CONNS);
+    CHECK(n_client_closed == N_CONNS);
+    CHECK(n_server_closed == N_CONNS);
+    // A call on a socket never connected fails through its handler, not inline
+    Socket idle(r);
+    bool is_failed = false;
+    call([&]() {
+        idle.async_send("x", [&](const std::string& error) {
+            CHECK(!is_calling && !error.empty());
+            is_failed = true;
+        });
+    });
+    CHECK(!is_failed);
+    r->run_once(0);
+    CHECK(is_failed);
+    return 0;
+}
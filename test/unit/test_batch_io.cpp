@@ -0,0 +1,65 @@
+#include "check.hpp"
+#include <poll.h>
+
+using namespace jrReliableUDP;
+
+static int open_udp(sockaddr_in& addr) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(fd != -1);
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(0 == ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    socklen_t len = sizeof(addr);
+    CHECK(0 == ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len));
+    return fd;
+}
+
+// Receive n packets, checking no recvmmsg returns more than the batch
+static std::vector<RawPacket> recv_all(BatchIO& io, int fd, size_t n) {
+    std::vector<RawPacket> got;
+    while(got.size() < n) {
+        pollfd p = {fd, POLLIN, 0};
+        CHECK(::poll(&p, 1, 2000) == 1);
+        int k = io.recv();
+        CHECK((k > 0) && (static_cast<size_t>(k) <= io.get_batch()));
+        for(int i = 0; i < k; ++i) {
+            RawPacket pkg;
+            CHECK(pkg.decode(io.buf(i), io.offset(i), io.size(i)));
+            got.push_back(pkg);
+        }
+    }
+    return got;
+}
+
+// Queued packets leave in sendmmsg batches, a full batch flushes itself, and recvmmsg hands them over in order
+// with their payloads referenced in the receive buffers
+int main() {
+    sockaddr_in a, b;
+    int fa = open_udp(a);
+    int fb = open_udp(b);
+    BatchIO tx(fa, 8);
+    BatchIO rx(fb, 8);
+    const int N = 20;
+    for(int i = 0; i < N; ++i) {
+        tx.push(RawPacket(i, 0, 0, DATA, "p" + std::to_string(i)), b);
+    }
+    tx.flush();
+    std::vector<RawPacket> got = recv_all(rx, fb, N);
+    CHECK(got.size() == N);
+    for(int i = 0; i < N; ++i) {
+        CHECK(got[i].seq_num == static_cast<uint32_t>(i));
+        CHECK(std::string(got[i].payload(), got[i].len) == "p" + std::to_string(i));
+    }
+    // Packets kept from one batch stay valid while the next one is received
+    rx.set_batch(1);
+    tx.push(RawPacket(100, 0, 0, DATA, "x"), b);
+    tx.push(RawPacket(101, 0, 0, DATA, "y"), b);
+    tx.flush();
+    got = recv_all(rx, fb, 2);
+    CHECK((got[0].seq_num == 100) && (got[1].seq_num == 101));
+    CHECK(std::string(got[0].payload(), got[0].len) == "x");
+    ::close(fa);
+    ::close(fb);
+    return 0;
+}
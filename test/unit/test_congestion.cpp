@@ -0,0 +1,140 @@
+#include "relay.hpp"
+#include <set>
+#include <cmath>
+
+using namespace jrReliableUDP;
+
+static AckSample ack_of(int64_t now_us, uint32_t acked, uint64_t prior_delivered, double rate) {
+    AckSample s;
+    s.now_us = now_us;
+    s.acked = acked;
+    s.pipe = 0;
+    s.delivered = prior_delivered + acked;
+    s.prior_delivered = prior_delivered;
+    s.delivery_rate = rate;
+    s.is_app_limited = false;
+    s.is_cwnd_limited = true;
+    s.in_recovery = false;
+    return s;
+}
+
+// A whole window acked per round trip
+static void run_rounds(CongestionControl& cc, int64_t& now_us, int64_t rtt_us, int n) {
+    for(int i = 0; i < n; ++i) {
+        now_us += rtt_us;
+        cc.on_rtt(rtt_us, now_us);
+        cc.on_ack(ack_of(now_us, cc.cwnd(), 0, 0));
+    }
+}
+
+// A transfer through a relay dropping the first transmission of every 50th packet
+static void transfer(CongestionAlgorithm algo, uint16_t port, uint16_t relay_port) {
+    const int N = 500;
+    std::set<uint32_t> seen;
+    Relay relay(relay_port, port, [&](const Relay::Datagram& d) {
+        return d.to_server && IS_DATA(d.type) && (d.seq % 50 == 0) && seen.insert(d.seq).second;
+    });
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(port);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < N; ++i) {
+            CHECK(s.recv_pkg() == "Package" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.set_congestion(algo);
+    c.connect("127.0.0.1", relay_port);
+    for(int i = 0; i < N; ++i) {
+        c.send_pkg("Package" + std::to_string(i));
+    }
+    c.disconnect();
+    CHECK(seen.size() >= N / 50);
+}
+
+int main() {
+    // Reno: slow start doubles per round, congestion avoidance adds one, a loss halves the flight
+    std::unique_ptr<CongestionControl> reno = CongestionControl::create(RENO);
+    CHECK((reno->algorithm() == RENO) && (reno->cwnd() == INIT_CWND) && (reno->pacing_rate() == 0));
+    reno->on_ack(ack_of(0, 10, 0, 0));
+    CHECK(reno->cwnd() == 20);
+    AckSample idle = ack_of(0, 20, 0, 0);
+    idle.is_cwnd_limited = false;
+    reno->on_ack(idle);
+    AckSample recovering = ack_of(0, 20, 0, 0);
+    recovering.in_recovery = true;
+    reno->on_ack(recovering);
+    CHECK(reno->cwnd() == 20);  // Growth is earned by a full window only, and never in recovery
+    reno->on_loss(20, 0);
+    CHECK(reno->cwnd() == 10);
+    reno->on_ack(ack_of(0, 10, 0, 0));
+    CHECK(reno->cwnd() == 11);
+    reno->on_rtt(10000, 0);
+    CHECK(std::abs(reno->pacing_rate() - 1.2 * 11 * 100) < 1e-6);
+    reno->on_timeout(22);
+    CHECK(reno->cwnd() == 1);
+    reno->on_ack(ack_of(0, 1, 0, 0));
+    CHECK(reno->cwnd() == 2);
+
+    // CUBIC: a loss leaves 70% of the window, which climbs back along the cubic, flat near W_max (reached
+    // K = cbrt(0.3 W_max / 0.4) s later) and steeper past it
+    std::unique_ptr<CongestionControl> cubic = CongestionControl::create(CUBIC);
+    CHECK(cubic->algorithm() == CUBIC);
+    int64_t now_us = 0;
+    const int64_t RTT_US = 100000;
+    while(cubic->cwnd() < 100) {
+        run_rounds(*cubic, now_us, RTT_US, 1);
+    }
+    cubic->on_loss(cubic->cwnd(), now_us);
+    uint32_t w_max = cubic->cwnd() * 10 / 7;
+    CHECK((cubic->cwnd() >= 69) && (w_max >= 100) && (w_max <= 162));
+    double K = std::cbrt((w_max - cubic->cwnd()) / 0.4);
+    int rounds_to_k = static_cast<int>(K * 1e6 / RTT_US);
+    run_rounds(*cubic, now_us, RTT_US, rounds_to_k / 4);
+    uint32_t early = cubic->cwnd();
+    run_rounds(*cubic, now_us, RTT_US, rounds_to_k - rounds_to_k / 4);
+    uint32_t at_k = cubic->cwnd();
+    CHECK((at_k + 5 >= w_max) && (at_k <= w_max + 5));
+    run_rounds(*cubic, now_us, RTT_US, rounds_to_k);
+    uint32_t late = cubic->cwnd();
+    // Concave before W_max, convex after: the first quarter gains more than the rest, and as long again past K
+    // climbs as far above W_max as the loss fell below it
+    CHECK((early > w_max * 7 / 10) && (early - w_max * 7 / 10 > at_k - early));
+    CHECK((late + 5 >= w_max + w_max * 3 / 10) && (late <= w_max + w_max * 3 / 10 + 10));
+    cubic->on_timeout(late);
+    CHECK(cubic->cwnd() == 1);
+
+    // BBR over a 1000 packets/s bottleneck with 20 ms of propagation delay: the window settles at twice the
+    // bandwidth-delay product, the pace around the bandwidth, and a loss changes neither
+    std::unique_ptr<CongestionControl> bbr = CongestionControl::create(BBR);
+    CHECK(bbr->algorithm() == BBR);
+    const double BW = 1000;
+    const int64_t MIN_RTT_US = 20000;
+    now_us = 0;
+    uint64_t delivered = 0;
+    for(int i = 0; i < 200; ++i) {
+        uint32_t flight = bbr->cwnd();
+        // Anything beyond the BDP queues at the bottleneck and stretches the round trip
+        int64_t rtt_us = std::max<int64_t>(MIN_RTT_US, static_cast<int64_t>(flight * 1e6 / BW));
+        now_us += rtt_us;
+        bbr->on_rtt(rtt_us, now_us);
+        bbr->on_ack(ack_of(now_us, flight, delivered, flight * 1e6 / rtt_us));
+        delivered += flight;
+    }
+    CHECK(bbr->cwnd() == 40);
+    CHECK((bbr->pacing_rate() >= 0.75 * BW - 1) && (bbr->pacing_rate() <= 1.25 * BW + 1));
+    bbr->on_loss(bbr->cwnd(), now_us);
+    CHECK(bbr->cwnd() == 40);
+    bbr->on_timeout(40);
+    CHECK(bbr->cwnd() == 1);
+
+    // Each controller carries a real connection through losses
+    transfer(RENO, 19120, 19121);
+    transfer(CUBIC, 19122, 19123);
+    transfer(BBR, 19124, 19125);
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "check.hpp"
+#include <poll.h>
+
+using namespace jrReliableUDP;
+
+// A peer speaking the wire format by hand, so it can pick its ISN and forge what it likes
+class RawPeer {
+private:
+    int fd;
+    sockaddr_in to;
+
+public:
+    explicit RawPeer(uint16_t port) : fd(::socket(AF_INET, SOCK_DGRAM, 0)) {
+        CHECK(fd != -1);
+        ::memset(&to, 0, sizeof(to));
+        to.sin_family = AF_INET;
+        to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        to.sin_port = htons(port);
+    }
+    ~RawPeer() { ::close(fd); }
+
+    void send(const RawPacket& pkg) {
+        char buf[HEADER_SIZE + SYN_OPTIONS_SIZE + 64];
+        CHECK(pkg.len <= sizeof(buf) - HEADER_SIZE);
+        pkg.encode_header(buf);
+        ::memcpy(buf + HEADER_SIZE, pkg.payload(), pkg.len);
+        CHECK(::sendto(fd, buf, HEADER_SIZE + pkg.len, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to)) > 0);
+    }
+
+    // Next packet other than a PMTU probe, false after a second of nothing
+    bool recv(RawPacket& pkg) {
+        PacketBuf buf = PacketPool::frames().alloc();
+        while(true) {
+            pollfd p = {fd, POLLIN, 0};
+            if(::poll(&p, 1, 1000) != 1) {
+                return false;
+            }
+            ssize_t n = ::recv(fd, buf.data(), buf.capacity(), 0);
+            if((n > 0) && pkg.decode(buf, 0, n) && !IS_PROBE(pkg.type)) {
+                return true;
+            }
+        }
+    }
+
+    // The listener's SYN+ACK to our SYN at isn; returns the cookie, its SEQ
+    uint32_t handshake(uint32_t isn) {
+        char opts[SYN_OPTIONS_SIZE];
+        SynOptions o;
+        RawPacket syn(isn, 0, 256, SYN, opts, o.encode(opts));
+        send(syn);
+        RawPacket reply;
+        CHECK(recv(reply));
+        CHECK((reply.type == (SYN | ACK)) && (reply.ack_num == isn + 1));
+        return reply.seq_num;
+    }
+
+    // Data at seq, stream 0 and SSN 0, acking the listener's SYN
+    void send_data(uint32_t seq, uint32_t cookie, const std::string& data) {
+        send(RawPacket(seq, cookie + 1, 256, DATA | ACK, data));
+    }
+
+    // What the listener sends next is one of ours acked up to ack
+    void expect_ack(uint32_t ack) {
+        RawPacket pkg;
+        CHECK(recv(pkg) && IS_ACK(pkg.type) && (pkg.ack_num == ack));
+    }
+};
+
+// A SYN cookie listener keeps nothing for a SYN, and builds the connection from the peer's ACK: its ISN is the
+// SEQ before that packet's, whatever it picked, and whether a pure ACK or data completed the handshake.
+// An ACK whose cookie doesn't check out makes no connection.
+int main() {
+    const uint16_t PORT = 19230;
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.set_syn_cookies(true);
+        l.set_ack_policy(1, 0);   // ACKs at once: this thread ends right after reading, before a delayed ACK would go
+        l.listen();
+        ready.set_value();
+        Socket a = l.accept();
+        CHECK(a.recv_pkg() == "hello");
+        a.send_pkg(std::string("back"));
+        Socket b = l.accept();
+        CHECK(b.recv_pkg() == "world");
+    });
+
+    // Data for a cookie we never issued: RST, no connection
+    RawPeer forger(PORT);
+    forger.send_data(5, 0x12345678, "forged");
+    RawPacket rst;
+    CHECK(forger.recv(rst) && IS_RST(rst.type));
+
+    // A pure ACK completes the handshake, then data follows
+    RawPeer a(PORT);
+    uint32_t cookie = a.handshake(1000);
+    a.send(RawPacket(1001, cookie + 1, 256, ACK));
+    a.send_data(1001, cookie, "hello");
+    // The reply may come with the ACK or after it
+    RawPacket back;
+    do {
+        CHECK(a.recv(back) && IS_ACK(back.type) && (back.ack_num == 1002));
+    } while(!IS_DATA(back.type));
+    CHECK((back.seq_num == cookie + 1) && (std::string(back.payload(), back.len) == "back"));
+
+    // Data completes it, with an ISN about to wrap around
+    RawPeer b(PORT);
+    cookie = b.handshake(0xFFFFFFF0);
+    b.send_data(0xFFFFFFF1, cookie, "world");
+    b.expect_ack(0xFFFFFFF2);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "relay.hpp"
+#include <set>
+
+using namespace jrReliableUDP;
+
+static std::string message(size_t n, int k) {
+    std::string m(n, '\0');
+    for(size_t i = 0; i < n; ++i) {
+        m[i] = static_cast<char>(i * 7 + k);
+    }
+    return m;
+}
+
+// Messages of any size are cut into fragments and come out whole and in order, through losses of fragments too.
+// Reassembled into a caller's buffer, what doesn't fit is dropped and the full size reported.
+int main() {
+    const uint16_t PORT = 19150;
+    const uint16_t RELAY = 19151;
+    const std::vector<size_t> sizes = {1, BASE_MSS - 1, BASE_MSS, BASE_MSS + 1, 3 * BASE_MSS, 1 << 20, 100000};
+    std::set<uint32_t> seen;
+    Relay relay(RELAY, PORT, [&](const Relay::Datagram& d) {
+        return d.to_server && IS_DATA(d.type) && (d.seq % 37 == 0) && seen.insert(d.seq).second;
+    });
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(size_t k = 0; k < sizes.size(); ++k) {
+            CHECK(s.recv_pkg() == message(sizes[k], k));
+        }
+        // Straight into a buffer, whole and cut short
+        std::vector<char> buf(1 << 20);
+        CHECK(s.recv_pkg(buf.data(), buf.size()) == (1 << 20));
+        CHECK(std::string(buf.data(), buf.size()) == message(1 << 20, 7));
+        std::vector<char> small(1000);
+        CHECK(s.recv_pkg(small.data(), small.size()) == 50000);
+        CHECK(std::string(small.data(), small.size()) == message(50000, 8).substr(0, 1000));
+        // The rest of the cut message doesn't leak into the next
+        CHECK(s.recv_pkg() == message(10, 9));
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", RELAY);
+    for(size_t k = 0; k < sizes.size(); ++k) {
+        c.send_pkg(message(sizes[k], k));
+    }
+    c.send_pkg(message(1 << 20, 7));
+    c.send_pkg(message(50000, 8));
+    c.send_pkg(message(10, 9));
+    c.disconnect();
+    CHECK(seen.size() >= 10);
+    // Every packet is a fragment of at most the largest payload either end allows
+    for(const Relay::Datagram& d : relay.log()) {
+        CHECK(!d.to_server || !IS_DATA(d.type) || (d.len <= MAX_SIZE));
+    }
+    return 0;
+}
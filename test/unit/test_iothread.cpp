@@ -0,0 +1,81 @@
+#include "check.hpp"
+#include "../../src/iothread.hpp"
+#include <atomic>
+
+using namespace jrReliableUDP;
+
+// Channels of two IoThreads used from many application threads: each client channel is closed by one thread
+// while another is still sending on it, blocked on a ring of 4. Neither may miss its wakeup, and what the server
+// reads is what was sent, in order, up to where the close cut it off.
+int main() {
+    const uint16_t PORT = 19220;
+    const int N_CONNS = 8;
+    const int N = 2000;
+    const int CLOSE_AFTER = 500;
+    IoThread server_io(4);
+    server_io.listen(PORT);
+    std::vector<int> n_rcvd(N_CONNS, -1);
+    std::thread acceptor([&]() {
+        std::vector<std::thread> readers;
+        for(int i = 0; i < N_CONNS; ++i) {
+            std::shared_ptr<Channel> ch = server_io.accept();
+            readers.emplace_back([&, ch]() {
+                std::string m = ch->recv();
+                int id = std::stoi(m.substr(0, m.find(':')));
+                int k = 0;
+                for(; !m.empty(); m = ch->recv(), ++k) {
+                    CHECK(m == std::to_string(id) + ":" + std::to_string(k));
+                }
+                ch->close();
+                n_rcvd[id] = k;
+            });
+        }
+        for(auto& t : readers) {
+            t.join();
+        }
+    });
+
+    IoThread client_io(4);
+    std::vector<std::atomic<int>> n_sent(N_CONNS);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < N_CONNS; ++i) {
+        n_sent[i].store(0);
+        threads.emplace_back([&, i]() {
+            std::shared_ptr<Channel> ch = client_io.connect("127.0.0.1", PORT);
+            std::thread closer([&]() {
+                while(n_sent[i].load() < CLOSE_AFTER) {
+                    std::this_thread::yield();
+                }
+                ch->close();
+            });
+            try {
+                for(int k = 0; k < N; ++k) {
+                    ch->send(std::to_string(i) + ":" + std::to_string(k));
+                    ++n_sent[i];
+                }
+            } catch(const std::runtime_error&) {
+                // Closed under us
+            }
+            closer.join();
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    acceptor.join();
+    for(int i = 0; i < N_CONNS; ++i) {
+        // Everything sent before the close was asked for gets through, what came after may be dropped
+        CHECK((n_rcvd[i] >= CLOSE_AFTER) && (n_rcvd[i] <= n_sent[i].load()));
+    }
+
+    // A channel outliving its IoThread is broken, and using it wakes nothing that is gone
+    std::shared_ptr<Channel> orphan;
+    {
+        IoThread io;
+        orphan = io.connect("127.0.0.1", PORT);
+    }
+    CHECK(orphan->recv().empty() && !orphan->last_error().empty());
+    CHECK_THROWS(orphan->send("late"));
+    orphan->close();
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "relay.hpp"
+#include <atomic>
+
+using namespace jrReliableUDP;
+
+// Message of the error f ends with, empty if it returns
+template<typename F>
+static std::string error_of(F f) {
+    try {
+        f();
+    } catch(const std::runtime_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+// A peer that stops answering is given up after the keepalive probes, one that is merely quiet is not.
+// An idle timeout ends a connection nobody uses, whatever keepalives go over it meanwhile.
+int main() {
+    // Dead peer: once the path drops everything, the prober fails after idle + probes * interval and the other
+    // side, hearing nothing either, runs into its idle timeout
+    const uint16_t PORT = 19250;
+    const uint16_t RELAY = 19251;
+    std::atomic<bool> is_cut(false);
+    Relay cut(RELAY, PORT, [&](const Relay::Datagram&) { return is_cut.load(); });
+    {
+        Peer server([&](std::promise<void>& ready) {
+            Socket l;
+            l.bind(PORT);
+            l.set_idle_timeout(300);
+            l.listen();
+            ready.set_value();
+            Socket s = l.accept();
+            CHECK(s.recv_pkg() == "ping");
+            s.send_pkg(std::string("pong"));
+            int64_t start = get_now_ms();
+            CHECK(error_of([&]() { s.recv_pkg(); }) == "Connection idle timeout.");
+            CHECK(get_now_ms() - start >= 250);
+        });
+        Socket c;
+        c.set_keepalive(50, 20, 3);
+        c.connect("127.0.0.1", RELAY);
+        c.send_pkg(std::string("ping"));
+        CHECK(c.recv_pkg() == "pong");
+        is_cut = true;
+        int64_t start = get_now_ms();
+        CHECK(error_of([&]() { c.recv_pkg(); }) == "Connection timed out, keepalive probes unanswered.");
+        int64_t elapsed = get_now_ms() - start;
+        CHECK((elapsed >= 100) && (elapsed < 2000));
+    }
+    size_t n_probes = 0;
+    for(const Relay::Datagram& d : cut.log()) {
+        n_probes += (d.to_server && d.is_dropped && IS_DATA(d.type) && (d.len == 0)) ? 1 : 0;
+    }
+    CHECK(n_probes == 3);
+
+    // Quiet peer: the probes are answered, the connection outlives many keepalive periods and still carries data
+    const uint16_t QUIET_PORT = 19252;
+    const uint16_t QUIET_RELAY = 19253;
+    Relay quiet(QUIET_RELAY, QUIET_PORT);
+    {
+        Peer server([&](std::promise<void>& ready) {
+            Socket l;
+            l.bind(QUIET_PORT);
+            l.listen();
+            ready.set_value();
+            Socket s = l.accept();
+            CHECK(s.recv_pkg() == "still here");
+            CHECK(s.recv_pkg().empty());
+            s.disconnect();
+        });
+        Socket c;
+        c.set_keepalive(30, 20, 2);
+        c.connect("127.0.0.1", QUIET_RELAY);
+        int64_t until = get_now_ms() + 500;
+        while(get_now_ms() < until) {
+            c.get_reactor()->run_once(10);
+        }
+        c.send_pkg(std::string("still here"));
+        c.disconnect();
+    }
+    n_probes = 0;
+    for(const Relay::Datagram& d : quiet.log()) {
+        n_probes += (d.to_server && IS_DATA(d.type) && (d.len == 0)) ? 1 : 0;
+    }
+    CHECK(n_probes >= 5);
+
+    // Keepalives aren't use: the idle side aborts on time and resets the prober
+    const uint16_t IDLE_PORT = 19254;
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(IDLE_PORT);
+        l.set_idle_timeout(200);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        int64_t start = get_now_ms();
+        CHECK(error_of([&]() { s.recv_pkg(); }) == "Connection idle timeout.");
+        CHECK(get_now_ms() - start >= 150);
+    });
+    Socket c;
+    c.set_keepalive(30, 20, 2);
+    c.connect("127.0.0.1", IDLE_PORT);
+    CHECK(error_of([&]() { c.recv_pkg(); }) == "Connection reset by peer.");
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "relay.hpp"
+
+using namespace jrReliableUDP;
+
+// Dropping a socket in TIME_WAIT returns at once: the reactor keeps its endpoint, still answering the peer's
+// retransmitted FIN, and closes it when TIME_WAIT ends. Nothing blocks, not even inside a completion handler.
+int main() {
+    const uint16_t PORT = 19082;
+    const uint16_t RELAY = 19083;
+    const uint16_t CLIENT_PORT = 19084;
+    bool is_fin_seen = false;
+    bool is_ack_dropped = false;
+    Relay relay(RELAY, PORT, [&](const Relay::Datagram& d) {
+        // The ACK of the server's FIN, once: the server has to resend its FIN to a socket the user dropped
+        is_fin_seen = is_fin_seen || (!d.to_server && IS_FIN(d.type));
+        if(d.to_server && is_fin_seen && IS_ACK(d.type) && !is_ack_dropped) {
+            is_ack_dropped = true;
+            return true;
+        }
+        return false;
+    });
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        for(int i = 0; i < 2; ++i) {
+            Socket s = l.accept();
+            CHECK(s.recv_pkg() == "Package");
+            CHECK(s.recv_pkg().empty());
+            s.disconnect();     // Throws unless our FIN is ACKed at last
+        }
+    });
+    std::shared_ptr<Reactor> r = std::make_shared<Reactor>();
+    {
+        Socket c(r);
+        c.bind(CLIENT_PORT);
+        c.connect("127.0.0.1", RELAY);
+        c.send_pkg("Package");
+        c.disconnect();
+        int64_t start = get_now_ms();
+        c = Socket(r);
+        CHECK(get_now_ms() - start < 20);
+    }
+    // The port stays taken while the reactor holds the endpoint
+    Socket d(r);
+    CHECK_THROWS(d.bind(CLIENT_PORT));
+    int64_t start = get_now_ms();
+    while(true) {
+        r->run_once(10);
+        try {
+            Socket e(r);
+            e.bind(CLIENT_PORT);
+            break;
+        } catch(const std::runtime_error&) {
+            CHECK(get_now_ms() - start < 5000);
+        }
+    }
+    relay.stop();
+    int fins = 0;
+    int fin_acks = 0;
+    for(const Relay::Datagram& dg : relay.log()) {
+        fins += (!dg.to_server && IS_FIN(dg.type)) ? 1 : 0;
+        fin_acks += (dg.to_server && (fins > 0) && IS_ACK(dg.type)) ? 1 : 0;
+    }
+    CHECK(fins >= 2);
+    CHECK(fin_acks >= 2);
+    // The handle may also go from a handler the loop runs
+    std::shared_ptr<Socket> c = std::make_shared<Socket>(r);
+    c->connect("127.0.0.1", PORT);
+    c->send_pkg("Package");
+    bool is_done = false;
+    int64_t elapsed = -1;
+    c->async_disconnect([&](const std::string& error) {
+        CHECK(error.empty());
+        int64_t t = get_now_ms();
+        c.reset();
+        elapsed = get_now_ms() - t;
+        is_done = true;
+    });
+    while(!is_done) {
+        r->run_once(-1);
+    }
+    CHECK(elapsed < 20);
+    // Still in TIME_WAIT, and served without anyone holding it
+    for(int64_t t = get_now_ms(); get_now_ms() - t < 500; ) {
+        r->run_once(10);
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "relay.hpp"
+
+using namespace jrReliableUDP;
+
+// Sends N messages of 4000 bytes to a server taking at most server_mss, through a relay that drops whatever
+// is larger than mtu bytes of IP; returns the client's path MSS at the end
+static uint16_t transfer(uint16_t port, uint16_t relay_port, size_t mtu, uint16_t server_mss, std::vector<Relay::Datagram>& log) {
+    const int N = 300;
+    const std::string m(4000, 'x');
+    Relay relay(relay_port, port, [&](const Relay::Datagram& d) { return d.size + IP_UDP_SIZE > mtu; });
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(port);
+        l.set_mss(server_mss);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < N; ++i) {
+            CHECK(s.recv_pkg() == m);
+        }
+        s.send_pkg("done");
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", relay_port);
+    CHECK(c.path_mss() <= BASE_MSS);    // The search starts from the base
+    for(int i = 0; i < N; ++i) {
+        c.send_pkg(m);
+    }
+    CHECK(c.recv_pkg() == "done");
+    uint16_t mss = c.path_mss();
+    c.disconnect();
+    log = relay.log();
+    return mss;
+}
+
+// Packets start at BASE_MSS and grow as probes get through, up to the smaller MSS both ends announced; a
+// probe too large for the path is lost without costing any data
+int main() {
+    std::vector<Relay::Datagram> log;
+    // An Ethernet MTU on the way: the 1500 byte probe gets through, the jumbo one never does
+    uint16_t mss = transfer(19160, 19161, 1500, MAX_SIZE, log);
+    CHECK(mss == 1500 - IP_UDP_SIZE - HEADER_SIZE);
+    int lost_probes = 0;
+    for(const Relay::Datagram& d : log) {
+        if(d.is_dropped) {
+            CHECK(IS_PROBE(d.type));
+            ++lost_probes;
+        }
+        CHECK(!IS_DATA(d.type) || (d.len <= mss));
+    }
+    CHECK(lost_probes >= MAX_PROBES);
+    // Nothing in the way: jumbo packets on loopback
+    mss = transfer(19162, 19163, 65536, MAX_SIZE, log);
+    CHECK(mss == MAX_SIZE);
+    // The server takes no more than 1000 bytes: neither side sends more, whatever the path allows
+    mss = transfer(19164, 19165, 65536, 1000, log);
+    CHECK(mss == 1000);
+    for(const Relay::Datagram& d : log) {
+        CHECK(d.len <= 1000);
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "check.hpp"
+#include <poll.h>
+
+using namespace jrReliableUDP;
+
+static int open_udp(sockaddr_in& addr) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(fd != -1);
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(0 == ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    socklen_t len = sizeof(addr);
+    CHECK(0 == ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len));
+    return fd;
+}
+
+// A run of equal-sized datagrams to one peer, with a shorter one closing it, goes out as GSO buffers and may come
+// back GRO-coalesced: either way every datagram is split out again, in order and intact. Without kernel support
+// set_offload returns false and the same traffic goes one datagram at a time.
+static void check_raw(bool offload) {
+    sockaddr_in a, b;
+    int fa = open_udp(a);
+    int fb = open_udp(b);
+    BatchIO tx(fa, 64);
+    BatchIO rx(fb, 64);
+    bool is_on = tx.set_offload(offload);
+    rx.set_offload(offload);
+    CHECK(offload || !is_on);
+    const int N = 40;
+    for(int i = 0; i < N; ++i) {
+        std::string payload((i == N - 1) ? 100 : 500, static_cast<char>('a' + i % 26));
+        tx.push(RawPacket(i, 0, 0, DATA, payload), b);
+    }
+    tx.flush();
+    int got = 0;
+    while(got < N) {
+        pollfd p = {fb, POLLIN, 0};
+        CHECK(::poll(&p, 1, 2000) == 1);
+        int k = rx.recv();
+        for(int i = 0; i < k; ++i, ++got) {
+            RawPacket pkg;
+            CHECK(pkg.decode(rx.buf(i), rx.offset(i), rx.size(i)));
+            CHECK(pkg.seq_num == static_cast<uint32_t>(got));
+            CHECK(pkg.len == ((got == N - 1) ? 100 : 500));
+            CHECK(pkg.payload()[0] == static_cast<char>('a' + got % 26));
+        }
+    }
+    ::close(fa);
+    ::close(fb);
+}
+
+int main() {
+    check_raw(false);
+    check_raw(true);
+    // The same through connections with offload on at both ends
+    const uint16_t PORT = 19030;
+    const int N = 2000;
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.set_offload(true);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < N; ++i) {
+            CHECK(s.recv_pkg() == std::string(400, static_cast<char>('a' + i % 26)));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.set_offload(true);
+    c.connect("127.0.0.1", PORT);
+    for(int i = 0; i < N; ++i) {
+        c.send_pkg(std::string(400, static_cast<char>('a' + i % 26)));
+    }
+    c.disconnect();
+    return 0;
+}
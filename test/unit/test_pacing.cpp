@@ -0,0 +1,78 @@
+#include "sender_rig.hpp"
+
+using namespace jrReliableUDP;
+
+// Window of 10 at a 20 ms RTT: Reno's slow start pace is 2 * 10 / 20 ms, one packet per ms. Returns the
+// SEQ 1 to 10 as they arrived.
+static std::vector<SenderRig::Arrival> send_window(PacingMode mode, bool is_txtime) {
+    SenderRig rig;
+    if(is_txtime) {
+        CHECK(rig.io.set_txtime(true));
+    }
+    rig.sender.set_pacing(mode);
+    rig.send(1);
+    rig.run_for(5);
+    CHECK(rig.count(0) == 1);
+    rig.ack(1, 100, static_cast<uint32_t>(get_now_us() - 20000));
+    CHECK(rig.rto.srtt >> 3 >= 20000);
+    rig.send(10);
+    rig.run_for(30);
+    std::vector<SenderRig::Arrival> window;
+    for(const SenderRig::Arrival& a : rig.arrivals) {
+        if(IS_DATA(a.type) && (a.seq >= 1)) {
+            window.push_back(a);
+        }
+    }
+    CHECK(window.size() == 10);
+    return window;
+}
+
+int main() {
+    // Unpaced, the whole window leaves in one burst
+    std::vector<SenderRig::Arrival> burst = send_window(PACING_OFF, false);
+    CHECK(burst.back().at_us - burst.front().at_us < 3000);
+    // Paced from the timer wheel, a burst of PACING_BURST and then one per ms
+    std::vector<SenderRig::Arrival> paced = send_window(PACING_USER, false);
+    CHECK(paced.back().at_us - paced.front().at_us >= 6000);
+    for(size_t i = PACING_BURST; i < paced.size(); ++i) {
+        CHECK(paced[i].at_us - paced[i - PACING_BURST].at_us >= 900);
+    }
+    // With SO_TXTIME the loop lets everything go and stamps each with its departure, 1 ms apart. The stamps are
+    // the send times the RTT is taken from; without fq on the device they arrive at once.
+    {
+        SenderRig probe;
+        if(probe.io.set_txtime(true)) {
+            std::vector<SenderRig::Arrival> stamped = send_window(PACING_TXTIME, true);
+            for(size_t i = 1; i < stamped.size(); ++i) {
+                uint32_t gap = stamped[i].ts_val - stamped[i - 1].ts_val;
+                CHECK((gap >= 990) && (gap <= 1010));
+            }
+        }
+    }
+
+    // Socket level: SO_TXTIME falls back to user pacing where refused, and a paced connection delivers everything
+    const uint16_t PORT = 19130;
+    const int N = 1000;
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < N; ++i) {
+            CHECK(s.recv_pkg() == "Package" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    CHECK(c.set_pacing(PACING_USER) == PACING_USER);
+    PacingMode mode = c.set_pacing(PACING_TXTIME);
+    CHECK((mode == PACING_TXTIME) || (mode == PACING_USER));
+    c.connect("127.0.0.1", PORT);
+    for(int i = 0; i < N; ++i) {
+        c.send_pkg("Package" + std::to_string(i));
+    }
+    c.disconnect();
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "check.hpp"
+
+using namespace jrReliableUDP;
+
+// Header and payload as they would sit in a received datagram
+static PacketBuf datagram(const RawPacket& pkg, size_t& n) {
+    PacketBuf buf = PacketPool::frames().alloc();
+    pkg.encode_header(buf.data());
+    ::memcpy(buf.data() + HEADER_SIZE, pkg.payload(), pkg.len);
+    n = HEADER_SIZE + pkg.len;
+    return buf;
+}
+
+int main() {
+    // Every field survives in network byte order, whatever the host's
+    RawPacket pkg(0xDEADBEEF, 0x01020304, 0xABCD, DATA | ACK | MORE, "payload");
+    pkg.stream = 7;
+    pkg.ts_val = 0x11223344;
+    pkg.ts_ecr = 0x55667788;
+    pkg.ssn = 0x99AABBCC;
+    size_t n;
+    PacketBuf buf = datagram(pkg, n);
+    CHECK(n == HEADER_SIZE + 7);
+    CHECK(static_cast<uint8_t>(buf.data()[0]) == 0xDE);    // Big endian on the wire
+    RawPacket got;
+    CHECK(got.decode(buf, 0, n));
+    CHECK(got.seq_num == 0xDEADBEEF);
+    CHECK(got.ack_num == 0x01020304);
+    CHECK(got.win_size == 0xABCD);
+    CHECK(got.type == (DATA | ACK | MORE));
+    CHECK(got.stream == 7);
+    CHECK(got.ts_val == 0x11223344);
+    CHECK(got.ts_ecr == 0x55667788);
+    CHECK(got.ssn == 0x99AABBCC);
+    CHECK((got.len == 7) && (std::string(got.payload(), got.len) == "payload"));
+    // The payload is referenced in the datagram's buffer, not copied
+    CHECK(got.payload() == buf.data() + HEADER_SIZE);
+
+    // A pure ACK has nothing after the header
+    RawPacket ack(5, 6, 7, ACK);
+    buf = datagram(ack, n);
+    CHECK(got.decode(buf, 0, n));
+    CHECK((got.len == 0) && (got.type == ACK) && !got.buf);
+
+    // Truncated datagrams and lengths past the datagram or the largest payload are rejected
+    buf = datagram(pkg, n);
+    CHECK(!got.decode(buf, 0, HEADER_SIZE - 1));
+    CHECK(!got.decode(buf, 0, n - 1));
+    uint16_t too_long = htons(MAX_SIZE + 1);
+    ::memcpy(buf.data() + HEADER_SIZE - 2, &too_long, 2);
+    CHECK(!got.decode(buf, 0, PacketPool::frames().get_block_size()));
+
+    // SYN options: the ticket travels only when there is one
+    SynOptions o;
+    o.mss = 1400;
+    o.has_wscale = true;
+    o.wscale = 3;
+    o.stream_buf = 4096;
+    char opts[SYN_OPTIONS_SIZE];
+    size_t len = o.encode(opts);
+    CHECK(len < SYN_OPTIONS_SIZE);
+    SynOptions parsed(RawPacket(0, 0, 0, SYN, opts, len));
+    CHECK((parsed.mss == 1400) && parsed.has_wscale && (parsed.wscale == 3) && (parsed.stream_buf == 4096));
+    CHECK(parsed.ticket == 0);
+    o.ticket = 0x0123456789ABCDEFULL;
+    len = o.encode(opts);
+    CHECK(len == SYN_OPTIONS_SIZE);
+    CHECK(SynOptions(RawPacket(0, 0, 0, SYN, opts, len)).ticket == 0x0123456789ABCDEFULL);
+    // A SYN without a payload gets the defaults
+    CHECK(SynOptions(RawPacket(0, 0, 0, SYN)).mss == BASE_MSS);
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "relay.hpp"
+#include <atomic>
+#include <map>
+#include <set>
+
+using namespace jrReliableUDP;
+
+// Partially reliable messages are given up after their retransmissions or lifetime: the receiver skips them
+// whole and what follows on their stream still comes. Datagrams are never retransmitted and never wait.
+int main() {
+    const uint16_t PORT = 19200;
+    const uint16_t RELAY = 19201;
+    const std::string stale(3 * BASE_MSS, 's');
+    // Stream 5: the second packet of the stale message is lost every time, the first gets through.
+    // Stream 6: the expired message, a single packet, is lost every time.
+    std::map<uint8_t, uint32_t> first;
+    std::atomic<int> n_lost5(0);
+    Relay relay(RELAY, PORT, [&](const Relay::Datagram& d) {
+        if(!d.to_server || !IS_DATA(d.type) || IS_SKIP(d.type)) {
+            return false;
+        }
+        uint32_t seq = first.emplace(d.stream, d.seq).first->second;
+        if((d.stream == 5) && (d.seq == seq + 1)) {
+            ++n_lost5;
+            return true;
+        }
+        return (d.stream == 6) && (d.seq == seq);
+    });
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        // Its first fragment arrived, but no part of the message is handed over
+        CHECK(s.recv_pkg(5) == "After5");
+        CHECK(s.recv_pkg(6) == "After6");
+        CHECK(s.recv_pkg(7) == "Fresh");
+        CHECK(s.recv_pkg(0) == "Before");
+        CHECK(s.recv_pkg(0) == "After0");
+        CHECK(s.recv_pkg(5).empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", RELAY);
+    int64_t start = get_now_ms();
+    c.send_pkg(std::string("Before"));
+    c.send_partial(stale, 0, 2, 5);
+    c.send_pkg(std::string("After5"), 5);
+    c.send_partial(std::string("Expired"), 50, -1, 6);
+    c.send_pkg(std::string("After6"), 6);
+    c.send_partial(std::string("Fresh"), 1000, 3, 7);
+    c.send_pkg(std::string("After0"));
+    c.disconnect();
+    // The original and its two retransmissions, then only the SKIP
+    CHECK(n_lost5 == 3);
+    CHECK(get_now_ms() - start >= 50);
+
+    // Datagrams through a path losing one in three: each is sent once, the rest arrive in order
+    const uint16_t DGRAM_PORT = 19202;
+    const uint16_t DGRAM_RELAY = 19203;
+    const int N = 300;
+    Relay lossy(DGRAM_RELAY, DGRAM_PORT, [&](const Relay::Datagram& d) {
+        return d.to_server && IS_DATA(d.type) && !IS_SKIP(d.type) && (d.stream == DGRAM_STREAM) && (d.seq % 3 == 0);
+    });
+    std::vector<std::string> got;
+    {
+        Peer sink([&](std::promise<void>& ready) {
+            Socket l;
+            l.bind(DGRAM_PORT);
+            l.listen();
+            ready.set_value();
+            Socket s = l.accept();
+            for(std::string d = s.recv_datagram(); !d.empty(); d = s.recv_datagram()) {
+                got.push_back(d);
+            }
+            CHECK(s.recv_pkg() == "Tail");
+            s.disconnect();
+        });
+        Socket d;
+        d.connect("127.0.0.1", DGRAM_RELAY);
+        for(int i = 0; i < N; ++i) {
+            d.send_datagram("Datagram" + std::to_string(i));
+        }
+        d.send_pkg(std::string("Tail"));
+        d.disconnect();
+    }
+    std::set<uint32_t> sent;
+    size_t n_dropped = 0;
+    for(const Relay::Datagram& r : lossy.log()) {
+        if(r.to_server && IS_DATA(r.type) && !IS_SKIP(r.type) && (r.stream == DGRAM_STREAM)) {
+            CHECK(sent.insert(r.seq).second);
+            n_dropped += r.is_dropped ? 1 : 0;
+        }
+    }
+    CHECK(sent.size() == N);
+    CHECK(got.size() == N - n_dropped);
+    for(size_t i = 1; i < got.size(); ++i) {
+        CHECK(std::stoi(got[i - 1].substr(8)) < std::stoi(got[i].substr(8)));
+    }
+    return 0;
+}
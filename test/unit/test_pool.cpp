@@ -0,0 +1,53 @@
+#include "check.hpp"
+#include "../../src/ring.hpp"
+
+using namespace jrReliableUDP;
+
+int main() {
+    PacketPool pool(64, 4);
+    CHECK(pool.get_block_size() == 64);
+    // Blocks are recycled: the last handle gone, the next alloc reuses it
+    PacketBuf a = pool.alloc();
+    char* p = a.data();
+    CHECK((a.use_count() == 1) && (a.capacity() == 64));
+    {
+        PacketBuf b = a;
+        CHECK(a.use_count() == 2);
+    }
+    CHECK(a.use_count() == 1);
+    a = PacketBuf();
+    PacketBuf c = pool.alloc();
+    CHECK(c.data() == p);
+    // More than a slab's worth carves another slab, all blocks distinct
+    std::vector<PacketBuf> held;
+    for(int i = 0; i < 10; ++i) {
+        held.push_back(pool.alloc());
+        for(int j = 0; j < i; ++j) {
+            CHECK(held[j].data() != held[i].data());
+        }
+    }
+    held.clear();
+
+    // The last handle may be dropped on another thread, the block still goes back to its pool
+    PacketBuf d = pool.alloc();
+    char* q = d.data();
+    std::thread([](PacketBuf buf) { buf = PacketBuf(); }, std::move(d)).join();
+    CHECK(!d);
+    bool is_reused = false;
+    for(int i = 0; i < 16; ++i) {
+        held.push_back(pool.alloc());
+        is_reused = is_reused || (held.back().data() == q);
+    }
+    CHECK(is_reused);
+    held.clear();
+
+    // A window slot lets go of its packet's buffer as soon as the window slides past it
+    Ring<RawPacket> r(8);
+    r.reset(0);
+    RawPacket pkg(0, 0, 0, DATA, "payload");
+    r.put(0, pkg, SENT);
+    CHECK(pkg.buf.use_count() == 2);
+    r.pop_front();
+    CHECK(pkg.buf.use_count() == 1);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "check.hpp"
+#include <fcntl.h>
+
+using namespace jrReliableUDP;
+
+static sockaddr_in make_addr(const char* ip, uint16_t port) {
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, ip, &addr.sin_addr);
+    return addr;
+}
+
+// One loop serves many connections. A peer that can't be reached, whether the kernel refuses to send to it
+// or it answers with ICMP port unreachable, costs its own connection at most, never the loop or the others.
+int main() {
+    const uint16_t PORT = 19080;
+    const uint16_t CLOSED_PORT = 19081;     // Nobody listens there
+    const int N_CONNS = 8;
+    const int N = 200;
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        std::vector<Socket> ss;
+        for(int i = 0; i < N_CONNS; ++i) {
+            ss.push_back(l.accept());
+        }
+        for(int k = 0; k < N; ++k) {
+            for(auto& s : ss) {
+                std::string m = s.recv_pkg();
+                CHECK(m.substr(m.find(':')) == ":" + std::to_string(k));
+            }
+        }
+        for(auto& s : ss) {
+            CHECK(s.recv_pkg().empty());
+            s.disconnect();
+        }
+    });
+    std::shared_ptr<Reactor> r = std::make_shared<Reactor>();
+    // Both dead ends share the loop with the live connections below and keep retrying their SYN meanwhile
+    std::shared_ptr<Endpoint> dead = r->open();
+    CHECK(::fcntl(dead->sockfd, F_GETFL) & O_NONBLOCK);
+    std::shared_ptr<Connection> refused = dead->connect(make_addr("127.0.0.1", CLOSED_PORT));
+    refused->open();
+    std::shared_ptr<Connection> broadcast = dead->connect(make_addr("255.255.255.255", PORT));
+    broadcast->open();  // No SO_BROADCAST, sendmmsg fails with EACCES
+    r->run_once(10);
+    std::vector<Socket> cs;
+    for(int i = 0; i < N_CONNS; ++i) {
+        cs.push_back(Socket(r));
+        cs.back().connect("127.0.0.1", PORT);
+    }
+    for(int k = 0; k < N; ++k) {
+        for(int i = 0; i < N_CONNS; ++i) {
+            cs[i].send_pkg(std::to_string(i) + ":" + std::to_string(k));
+        }
+    }
+    for(auto& c : cs) {
+        c.disconnect();
+    }
+    CHECK(refused->state() == SYN_SENT);
+    CHECK(broadcast->state() == SYN_SENT);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "check.hpp"
+#include "../../src/ring.hpp"
+
+using namespace jrReliableUDP;
+
+int main() {
+    // Capacity rounds up to a power of two and the window starts where it is reset
+    Ring<int> r(5);
+    r.reset(100);
+    CHECK(r.empty() && (r.front_seq() == 100) && (r.end_seq() == 100));
+    r.put(100, 1, SENT);
+    r.put(101, 2, SENT);
+    CHECK((r.size() == 2) && r.contains(101) && !r.contains(102) && !r.contains(99));
+    CHECK((r.at(100) == 1) && (r.state(101) == SENT));
+    // Out of order: the slots skipped over stay EMPTY until filled
+    r.put(105, 6, RECEIVED);
+    CHECK((r.size() == 6) && (r.state(103) == EMPTY) && (r.state(105) == RECEIVED));
+    r.put(103, 4, RECEIVED);
+    CHECK((r.state(103) == RECEIVED) && (r.size() == 6));
+    // Outside the window nothing is reported
+    CHECK(r.state(106) == EMPTY);
+    r.set_state(100, ACKED);
+    CHECK(r.state(100) == ACKED);
+    r.pop_front();
+    CHECK((r.front_seq() == 101) && !r.contains(100) && (r.size() == 5));
+
+    // Growing by doubling keeps every item at its SEQ
+    Ring<int> g(4);
+    g.reset(0);
+    for(int i = 0; i < 100; ++i) {
+        g.put(i, i * 10, SENT);
+        if(i % 3 == 0) {
+            g.pop_front();
+        }
+    }
+    for(uint32_t seq = g.front_seq(); seq != g.end_seq(); ++seq) {
+        CHECK((g.at(seq) == static_cast<int>(seq) * 10) && (g.state(seq) == SENT));
+    }
+    // A jump far past the tail grows to fit it at once
+    g.put(g.front_seq() + 1000, 7, QUEUED);
+    CHECK((g.at(g.front_seq() + 1000) == 7) && (g.size() == 1001));
+
+    // SEQ wraps around 2^32
+    Ring<int> w(8);
+    w.reset(0xFFFFFFFE);
+    for(uint32_t i = 0; i < 6; ++i) {
+        w.put(0xFFFFFFFE + i, static_cast<int>(i), SENT);
+    }
+    CHECK((w.size() == 6) && w.contains(0) && w.contains(3) && !w.contains(4) && !w.contains(0xFFFFFFFD));
+    CHECK((w.at(1) == 3) && (w.at(0xFFFFFFFF) == 1));
+    w.pop_front();
+    w.pop_front();
+    w.pop_front();
+    CHECK((w.front_seq() == 1) && (w.at(1) == 3));
+
+    // Reset drops everything
+    w.reset(42);
+    CHECK(w.empty() && (w.state(42) == EMPTY));
+    return 0;
+}
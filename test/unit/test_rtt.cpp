@@ -0,0 +1,87 @@
+#include "relay.hpp"
+
+using namespace jrReliableUDP;
+
+int main() {
+    // RFC 6298 in microseconds: SRTT = R, RTTVAR = R/2, RTO = SRTT + 4 RTTVAR, plus the peer's largest ACK delay
+    RTO r;
+    CHECK(r.timeout_ms() == RTO_INIT / 1000);
+    r.update(100000);
+    CHECK((r.srtt >> 3) == 100000);
+    CHECK(r.RTO_us == 100000 + 200000 + MAX_ACK_DELAY_MS * 1000);
+    // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+    r.update(100000);
+    CHECK(r.RTO_us == 100000 + 150000 + MAX_ACK_DELAY_MS * 1000);
+    // A steady RTT leaves the clock granularity as the variance term
+    for(int i = 0; i < 100; ++i) {
+        r.update(100000);
+    }
+    CHECK(r.RTO_us == 100000 + RTO_G + MAX_ACK_DELAY_MS * 1000);
+    // Sub-millisecond differences are kept, not rounded to the tick
+    RTO a, b;
+    a.update(1200);
+    b.update(1700);
+    CHECK((b.srtt - a.srtt) == (500 << 3));
+    // The ACK delay allowance keeps a tiny RTT above RTO_MIN; backoff multiplies up to RTO_MAX and the next sample
+    // resets it. Timeouts round up to the 1 ms tick.
+    for(int i = 0; i < 100; ++i) {
+        r.update(50);
+    }
+    CHECK((r.RTO_us == 50 + RTO_G + MAX_ACK_DELAY_MS * 1000) && (r.RTO_us >= RTO_MIN));
+    CHECK(r.timeout_ms() == 12);
+    r.backoff_factor = 4;
+    CHECK(r.timeout_ms() == (4 * r.RTO_us + 999) / 1000);
+    r.backoff_factor = 1 << 20;
+    CHECK(r.timeout_ms() == RTO_MAX / 1000);
+    r.update(50);
+    CHECK((r.backoff_factor == 1) && (r.timeout_ms() == 12));
+
+    // Karn: the last data packet is lost three times in a row, its ACK only comes after backed-off RTOs of 70 ms
+    // or more. Timed from the first transmission that would be the RTT sample; the ACK echoes the send time of the
+    // retransmission it answers instead, so the sample leaves the backoff out.
+    const uint16_t PORT = 19110;
+    const uint16_t RELAY = 19111;
+    const uint32_t N = 50;
+    int n_dropped = 0;
+    Relay relay(RELAY, PORT, [&](const Relay::Datagram& d) {
+        return d.to_server && IS_DATA(d.type) && (d.seq == N) && (n_dropped++ < 3);
+    });
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(uint32_t i = 0; i < N; ++i) {
+            CHECK(s.recv_pkg() == "Package" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", RELAY);
+    for(uint32_t i = 0; i < N; ++i) {
+        c.send_pkg("Package" + std::to_string(i));
+    }
+    c.disconnect();
+    CHECK(n_dropped > 3);   // Sent four times at least
+    const Relay::Datagram* first = nullptr;
+    const Relay::Datagram* delivered = nullptr;
+    const Relay::Datagram* acked = nullptr;
+    std::vector<Relay::Datagram> log = relay.log();
+    for(const Relay::Datagram& d : log) {
+        if(d.to_server && IS_DATA(d.type) && (d.seq == N)) {
+            first = first ? first : &d;
+            delivered = d.is_dropped ? delivered : &d;
+        } else if(!d.to_server && IS_ACK(d.type) && (d.ack > N) && !acked) {
+            acked = &d;
+        }
+    }
+    CHECK(first && delivered && acked);
+    // Clock differences in wrapping microseconds. Three backed-off RTOs of RTO_MIN or more, each of which may fire
+    // up to a timer tick early.
+    int32_t backoff_us = static_cast<int32_t>(delivered->tsval - first->tsval);
+    CHECK(backoff_us >= 7 * RTO_MIN - 3 * 1000);
+    CHECK(static_cast<int32_t>(acked->tsecr - delivered->tsval) >= 0);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "relay.hpp"
+#include <set>
+#include <map>
+
+using namespace jrReliableUDP;
+
+// Losses inside the window are reported in SACK blocks and only the holes are resent, nothing that already got
+// through; the receiver buffers what came out of order and delivers everything in order.
+int main() {
+    const uint16_t PORT = 19070;
+    const uint16_t RELAY = 19071;
+    const int N = 300;
+    const std::set<uint32_t> lost = {10, 11, 40, 120};
+    std::set<uint32_t> seen;
+    Relay relay(RELAY, PORT, [&](const Relay::Datagram& d) {
+        // The first transmission of a few data packets in the middle of the transfer
+        return d.to_server && IS_DATA(d.type) && lost.count(d.seq) && seen.insert(d.seq).second;
+    });
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < N; ++i) {
+            CHECK(s.recv_pkg() == "Package" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", RELAY);
+    for(int i = 0; i < N; ++i) {
+        c.send_pkg("Package" + std::to_string(i));
+    }
+    c.disconnect();
+    std::map<uint32_t, int> sent;
+    bool has_sack = false;
+    for(const Relay::Datagram& d : relay.log()) {
+        if(d.to_server && IS_DATA(d.type)) {
+            ++sent[d.seq];
+        }
+        // A pure ACK with a payload carries SACK blocks
+        has_sack = has_sack || (!d.to_server && (d.type == ACK) && (d.len > 0));
+    }
+    CHECK(has_sack);
+    for(uint32_t seq : lost) {
+        CHECK(sent[seq] >= 2);
+    }
+    // Every hole resent, hardly anything else: no go-back-N over what the receiver already holds
+    int resent = 0;
+    for(auto& s : sent) {
+        resent += s.second - 1;
+    }
+    CHECK(resent >= static_cast<int>(lost.size()));
+    CHECK(resent <= static_cast<int>(lost.size()) + 8);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "check.hpp"
+
+using namespace jrReliableUDP;
+
+// The shard steer_by_peer's CBPF program picks for a peer on loopback
+static size_t shard_of(uint16_t port, size_t n_shards) {
+    uint32_t a = (0x7F000001u ^ port) * 0x9E3779B1u;
+    return (a >> 16) % n_shards;
+}
+
+// A sharded port spreads peers over its shards, each served by a thread of its own. With steer_by_peer a peer
+// always lands where the hash of its address puts it, and its whole connection stays on that shard.
+int main() {
+    const uint16_t PORT = 19090;
+    const uint16_t FIRST_CLIENT_PORT = 19091;
+    const size_t N_SHARDS = 4;
+    const int N_CLIENTS = 16;
+    const int N = 50;
+    std::vector<int> per_shard(N_SHARDS, 0);
+    for(int i = 0; i < N_CLIENTS; ++i) {
+        ++per_shard[shard_of(FIRST_CLIENT_PORT + i, N_SHARDS)];
+    }
+    for(int n : per_shard) {
+        CHECK(n > 0);   // Every shard takes part
+    }
+    Socket l;
+    l.bind(PORT);
+    l.listen(N_SHARDS, true);
+    CHECK(l.shard_count() == N_SHARDS);
+    CHECK_THROWS(l.accept(N_SHARDS));
+    std::vector<std::thread> threads;
+    for(size_t k = 0; k < N_SHARDS; ++k) {
+        threads.emplace_back([&, k]() {
+            for(int i = 0; i < per_shard[k]; ++i) {
+                Socket s = l.accept(k);
+                std::string port = s.recv_pkg();
+                CHECK(shard_of(std::stoi(port), N_SHARDS) == k);
+                for(int j = 0; j < N; ++j) {
+                    s.send_pkg(port + ":" + std::to_string(j));
+                }
+                CHECK(s.recv_pkg().empty());
+                s.disconnect();
+            }
+        });
+    }
+    for(int i = 0; i < N_CLIENTS; ++i) {
+        uint16_t port = FIRST_CLIENT_PORT + i;
+        Socket c;
+        c.bind(port);
+        c.connect("127.0.0.1", PORT);
+        c.send_pkg(std::to_string(port));
+        for(int j = 0; j < N; ++j) {
+            CHECK(c.recv_pkg() == std::to_string(port) + ":" + std::to_string(j));
+        }
+        c.disconnect();
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "relay.hpp"
+
+using namespace jrReliableUDP;
+
+static char byte_at(size_t i) {
+    return static_cast<char>((i * 31) >> 3);
+}
+
+// Stream mode carries bytes without message bounds: many short writes are coalesced into full packets, reads
+// take whatever has arrived, and the bytes come out exactly as written, gather and scatter calls included
+int main() {
+    const uint16_t PORT = 19180;
+    const uint16_t RELAY = 19181;
+    const size_t N_WRITES = 20000;
+    const size_t N = N_WRITES * 7 + 3 * 1000;
+    Relay relay(RELAY, PORT);
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        std::string got;
+        size_t len = 1;
+        while(got.size() < N) {
+            // Buffers of every size, a pair of them now and then
+            char a[4096], b[4096];
+            size_t n;
+            if(len % 3 == 0) {
+                iovec iov[2] = {{a, len % 4096}, {b, 17}};
+                n = s.readv(iov, 2);
+                CHECK((n > 0) && (n <= len % 4096 + 17));
+                got.append(a, std::min(n, len % 4096));
+                if(n > len % 4096) {
+                    got.append(b, n - len % 4096);
+                }
+            } else {
+                n = s.read(a, len % 4096 + 1);
+                CHECK((n > 0) && (n <= len % 4096 + 1));
+                got.append(a, n);
+            }
+            len = len * 7 + 3;
+        }
+        CHECK(got.size() == N);
+        for(size_t i = 0; i < N; ++i) {
+            CHECK(got[i] == byte_at(i));
+        }
+        char c;
+        CHECK(s.read(&c, 1) == 0);
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", RELAY);
+    std::string all(N, '\0');
+    for(size_t i = 0; i < N; ++i) {
+        all[i] = byte_at(i);
+    }
+    size_t off = 0;
+    for(size_t i = 0; i < N_WRITES; ++i, off += 7) {
+        CHECK(c.write(all.data() + off, 7) == 7);
+    }
+    for(int i = 0; i < 3; ++i, off += 1000) {
+        iovec iov[3] = {{&all[off], 1}, {&all[off + 1], 0}, {&all[off + 1], 999}};
+        CHECK(c.writev(iov, 3) == 1000);
+    }
+    c.disconnect();
+    // Coalesced: full packets rather than one per write
+    size_t n_data = 0;
+    for(const Relay::Datagram& d : relay.log()) {
+        n_data += (d.to_server && IS_DATA(d.type)) ? 1 : 0;
+    }
+    CHECK(n_data < N_WRITES / 20);
+
+    // With nodelay a one-byte request is answered at once, nothing waits for the previous one's ACK
+    const uint16_t PING_PORT = 19182;
+    const int ROUNDS = 200;
+    Peer echo([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PING_PORT);
+        l.set_nodelay(true);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        char b;
+        while(s.read(&b, 1) == 1) {
+            s.write(&b, 1);
+        }
+        s.disconnect();
+    });
+    Socket p;
+    p.set_nodelay(true);
+    p.connect("127.0.0.1", PING_PORT);
+    int64_t start = get_now_ms();
+    for(int i = 0; i < ROUNDS; ++i) {
+        char b = static_cast<char>(i);
+        CHECK(p.write(&b, 1) == 1);
+        char r;
+        CHECK((p.read(&r, 1) == 1) && (r == b));
+    }
+    CHECK(get_now_ms() - start < ROUNDS * ACK_DELAY_MS / 2);
+    p.disconnect();
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "relay.hpp"
+#include <atomic>
+
+using namespace jrReliableUDP;
+
+// Streams are ordered each on its own: a loss on one holds back none of the others, and with a stream buffer one
+// nobody reads from can't take the whole receive window
+int main() {
+    const uint16_t PORT = 19190;
+    const uint16_t RELAY = 19191;
+    const int N = 50;
+    // The only packet of stream 1 is lost every time until the server has read all of stream 2
+    std::atomic<bool> is_stream1_lost(true);
+    std::atomic<int> n_dropped(0);
+    Relay relay(RELAY, PORT, [&](const Relay::Datagram& d) {
+        if(!d.to_server || !IS_DATA(d.type) || (d.stream != 1) || !is_stream1_lost.load()) {
+            return false;
+        }
+        ++n_dropped;
+        return true;
+    });
+    {
+        Peer server([&](std::promise<void>& ready) {
+            Socket l;
+            l.bind(PORT);
+            l.listen();
+            ready.set_value();
+            Socket s = l.accept();
+            for(int i = 0; i < N; ++i) {
+                CHECK(s.recv_pkg(2) == "Package" + std::to_string(i));
+            }
+            // Stream 2, sent after it, is all in while stream 1's message has yet to get through
+            CHECK(n_dropped.load() > 0);
+            is_stream1_lost.store(false);
+            CHECK(s.recv_pkg(1) == "Blocked");
+            CHECK(s.recv_pkg(1).empty() && s.recv_pkg(2).empty());
+            s.disconnect();
+        });
+        Socket c;
+        c.connect("127.0.0.1", RELAY);
+        c.send_pkg(std::string("Blocked"), 1);
+        for(int i = 0; i < N; ++i) {
+            c.send_pkg("Package" + std::to_string(i), 2);
+        }
+        c.disconnect();
+    }
+
+    // Stream 3 is read only once stream 0 is done; it may hold 16 packets of the receiver's 256, the rest of it
+    // waits at the sender while stream 0 goes on
+    const uint16_t BUF_PORT = 19192;
+    const int N_SLOW = 400;
+    const int N_FAST = 2000;
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(BUF_PORT);
+        l.set_stream_buffer(16);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < N_FAST; ++i) {
+            CHECK(s.recv_pkg(0) == "Fast" + std::to_string(i));
+        }
+        for(int i = 0; i < N_SLOW; ++i) {
+            CHECK(s.recv_pkg(3) == "Slow" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg(0).empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.connect("127.0.0.1", BUF_PORT);
+    for(int i = 0; i < N_FAST; ++i) {
+        if(i < N_SLOW) {
+            c.send_pkg("Slow" + std::to_string(i), 3);
+        }
+        c.send_pkg("Fast" + std::to_string(i), 0);
+    }
+    c.disconnect();
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "relay.hpp"
+
+using namespace jrReliableUDP;
+
+// The client's first data packet of a connection, as the relay saw it
+struct Flight {
+    bool is_early;      // Sent with the SYN, before anything came back: it acks nothing
+    int n_sent;         // Its transmissions
+};
+
+// One request and its reply through a relay of its own, so the server sees every connection from a new port;
+// resumes with t if valid and returns the ticket for the next one
+static ResumptionTicket request(const Relay& relay, uint16_t relay_port, const ResumptionTicket& t, Flight& f) {
+    Socket c;
+    c.set_ticket(t);
+    c.connect("127.0.0.1", relay_port);
+    c.send_pkg(std::string("request"));
+    CHECK(c.recv_pkg() == "reply");
+    ResumptionTicket next = c.ticket();
+    c.disconnect();
+    f.is_early = false;
+    f.n_sent = 0;
+    uint32_t seq = 0;
+    for(const Relay::Datagram& d : relay.log()) {
+        if(!d.to_server || !IS_DATA(d.type)) {
+            continue;
+        }
+        if(f.n_sent == 0) {
+            seq = d.seq;
+            f.is_early = !IS_ACK(d.type);
+        }
+        f.n_sent += (d.seq == seq) ? 1 : 0;
+    }
+    return next;
+}
+
+// A server handing out tickets, answering n requests on one listener so its key stays the same
+static void serve(uint16_t port, bool is_cookies, int n, std::promise<void>& ready) {
+    Socket l;
+    l.bind(port);
+    l.set_zero_rtt(true);
+    l.set_syn_cookies(is_cookies);
+    l.listen();
+    ready.set_value();
+    for(int i = 0; i < n; ++i) {
+        Socket s = l.accept();
+        CHECK(s.recv_pkg() == "request");
+        s.send_pkg(std::string("reply"));
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    }
+}
+
+// A ticket from one connection lets the next send its request with the SYN, before the server said anything.
+// A ticket the server can't verify costs the round trip it would have saved and nothing else.
+int main() {
+    const uint16_t PORT = 19240;
+    const uint16_t COOKIE_PORT = 19245;
+    // Declared first, so each outlives the server and carries its last FIN
+    Relay r1(19241, PORT), r2(19242, PORT), r3(19243, PORT);
+    Relay c1(19246, COOKIE_PORT), c2(19247, COOKIE_PORT), c3(19248, COOKIE_PORT);
+    Flight f;
+    {
+        Peer server([&](std::promise<void>& ready) { serve(PORT, false, 3, ready); });
+        ResumptionTicket t = request(r1, 19241, ResumptionTicket(), f);
+        CHECK(t.valid() && (t.srtt_us > 0) && (t.wnd > 1));
+        CHECK(!f.is_early);    // The handshake first
+        t = request(r2, 19242, t, f);
+        CHECK(t.valid() && f.is_early);    // 0-RTT
+        // Tampered with: handshake as usual, the early data waits for it
+        t.token ^= 1;
+        t = request(r3, 19243, t, f);
+        CHECK(t.valid() && f.is_early);
+    }
+
+    // Behind SYN cookies nothing holds early data while the ticket is turned down: it is sent again
+    Peer server([&](std::promise<void>& ready) { serve(COOKIE_PORT, true, 3, ready); });
+    ResumptionTicket t = request(c1, 19246, ResumptionTicket(), f);
+    CHECK(t.valid());
+    t = request(c2, 19247, t, f);
+    CHECK(t.valid() && f.is_early && (f.n_sent == 1));
+    t.token ^= 1;
+    request(c3, 19248, t, f);
+    CHECK(f.is_early && (f.n_sent >= 2));
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "check.hpp"
+#include "../../src/timer.hpp"
+#include <random>
+
+using namespace jrReliableUDP;
+
+int main() {
+    // A timer fires on the first advance that reaches its expiry, never earlier, and only once
+    TimerWheel w(1000);
+    int fired = 0;
+    Timer a([&]() { ++fired; });
+    w.schedule(a, 1010);
+    CHECK(a.is_armed() && (w.size() == 1) && (w.next_deadline() == 1010));
+    w.advance(1009);
+    CHECK(fired == 0);
+    w.advance(1010);
+    CHECK((fired == 1) && !a.is_armed() && (w.size() == 0) && (w.next_deadline() == 0));
+    w.advance(5000);
+    CHECK(fired == 1);
+
+    // Cancelled and destroyed timers never fire; rescheduling moves the deadline either way
+    Timer b([&]() { ++fired; });
+    w.schedule(b, 6000);
+    w.cancel(b);
+    CHECK(!b.is_armed() && (w.size() == 0));
+    {
+        Timer c([&]() { ++fired; });
+        w.schedule(c, 6000);
+    }
+    CHECK(w.size() == 0);
+    w.schedule(b, 9000);
+    w.schedule(b, 5500);
+    CHECK((w.size() == 1) && (w.next_deadline() == 5500));
+    w.advance(8000);
+    CHECK(fired == 2);
+
+    // Already due: fires on the next advance, even one that doesn't move the clock. Re-armed from its own
+    // handler, it waits for the round after.
+    Timer d;
+    d.set_handler([&]() { ++fired; w.schedule(d, 0); });
+    w.schedule(d, 7000);
+    CHECK(w.next_deadline() == 7000);
+    w.advance(8000);
+    CHECK((fired == 3) && d.is_armed());
+    w.advance(8000);
+    CHECK((fired == 4) && d.is_armed());
+    w.cancel(d);
+
+    // Random timers over every level and the overflow list, checked against the exact deadlines
+    std::mt19937_64 rng(42);
+    const int N = 2000;
+    std::vector<std::unique_ptr<Timer>> timers;
+    std::vector<int64_t> fired_at(N, -1);
+    int64_t now = 8000;
+    int64_t last = now;
+    for(int i = 0; i < N; ++i) {
+        timers.emplace_back(new Timer([&, i]() { fired_at[i] = now; }));
+        int64_t span = int64_t(1) << (rng() % 27);    // Up to 2^26 ms, past the top level
+        w.schedule(*timers[i], now + 1 + static_cast<int64_t>(rng() % span));
+    }
+    // Cancel some and move others
+    for(int i = 0; i < N; i += 7) {
+        w.cancel(*timers[i]);
+    }
+    for(int i = 3; i < N; i += 11) {
+        w.schedule(*timers[i], now + 1 + static_cast<int64_t>(rng() % 100000));
+    }
+    while(w.size() > 0) {
+        int64_t expected = INT64_MAX;
+        for(auto& t : timers) {
+            if(t->is_armed()) {
+                expected = std::min(expected, t->deadline());
+            }
+        }
+        CHECK(w.next_deadline() == expected);
+        // Sometimes straight to the next deadline as the reactor does, sometimes a jump over many
+        now = (rng() % 2) ? expected : now + static_cast<int64_t>(rng() % 3000000);
+        w.advance(now);
+        for(int i = 0; i < N; ++i) {
+            if(!timers[i]->is_armed() && (fired_at[i] == now)) {
+                CHECK((timers[i]->deadline() > last) && (timers[i]->deadline() <= now));
+            }
+            CHECK(!timers[i]->is_armed() || (timers[i]->deadline() > now));
+        }
+        last = now;
+    }
+    for(int i = 0; i < N; ++i) {
+        bool is_cancelled = (i % 7 == 0) && (i % 11 != 3);  // Rescheduling re-arms a cancelled timer
+        CHECK((fired_at[i] == -1) == is_cancelled);
+    }
+    return 0;
+}
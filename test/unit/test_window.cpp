@@ -0,0 +1,34 @@
+#include "check.hpp"
+
+using namespace jrReliableUDP;
+
+// The send window slides on every ACK: a window far smaller than the transfer is refilled as ACKs come back,
+// and every message arrives once and in order.
+int main() {
+    const uint16_t PORT = 19010;
+    const int N = 5000;
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(PORT);
+        l.set_buffers(8, 8);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < N; ++i) {
+            CHECK(s.recv_pkg() == "Package" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.set_buffers(8, 8);
+    c.connect("127.0.0.1", PORT);
+    int64_t start = get_now_ms();
+    for(int i = 0; i < N; ++i) {
+        c.send_pkg("Package" + std::to_string(i));
+    }
+    c.disconnect();
+    // Stop-and-wait per window would cost an RTO whenever an ACK is delayed; sliding keeps loopback well under that
+    CHECK(get_now_ms() - start < 10000);
+    return 0;
+}
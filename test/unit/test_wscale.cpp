@@ -0,0 +1,63 @@
+#include "relay.hpp"
+
+using namespace jrReliableUDP;
+
+// Transfers n messages to a server with the given buffers through a relay; returns the largest window field the
+// server sent after its SYN, the one in the SYN being unscaled
+static uint16_t transfer(uint16_t port, uint16_t relay_port, uint32_t server_buf, int n, std::vector<Relay::Datagram>& log) {
+    Relay relay(relay_port, port);
+    Peer server([&](std::promise<void>& ready) {
+        Socket l;
+        l.bind(port);
+        l.set_buffers(server_buf, server_buf);
+        l.listen();
+        ready.set_value();
+        Socket s = l.accept();
+        for(int i = 0; i < n; ++i) {
+            CHECK(s.recv_pkg() == "Package" + std::to_string(i));
+        }
+        CHECK(s.recv_pkg().empty());
+        s.disconnect();
+    });
+    Socket c;
+    c.set_buffers(200000, 200000);
+    c.connect("127.0.0.1", relay_port);
+    for(int i = 0; i < n; ++i) {
+        c.send_pkg("Package" + std::to_string(i));
+    }
+    c.disconnect();
+    log = relay.log();
+    uint16_t wnd = 0;
+    for(const Relay::Datagram& d : log) {
+        if(!d.to_server && IS_SYN(d.type)) {
+            CHECK(d.wnd == std::min<uint32_t>(server_buf, UINT16_MAX));
+        } else if(!d.to_server) {
+            wnd = std::max(wnd, d.wnd);
+        }
+    }
+    return wnd;
+}
+
+// A receive buffer above 65535 packets is announced with the smallest scale that fits it, and the windows after
+// the SYN are scaled by it; a small one is honoured packet for packet
+int main() {
+    std::vector<Relay::Datagram> log;
+    // Scaled by 2: 200000 >> 2 at most, and more than a scale of 3 would allow
+    uint16_t big = transfer(19170, 19171, 200000, 2000, log);
+    CHECK((big > (UINT16_MAX >> 1)) && (big <= (200000 >> 2)));
+    uint16_t exact = transfer(19172, 19173, UINT16_MAX, 100, log);
+    CHECK(exact == UINT16_MAX);
+    // Four packets at most beyond the last ACK, one more as a window probe
+    uint16_t small = transfer(19174, 19175, 4, 500, log);
+    CHECK(small <= 4);
+    uint32_t acked = 0;
+    for(const Relay::Datagram& d : log) {
+        if(!d.to_server && IS_ACK(d.type) && seq_lt(acked, d.ack)) {
+            acked = d.ack;
+        }
+        if(d.to_server && IS_DATA(d.type) && (acked != 0)) {
+            CHECK(seq_lt(d.seq, acked + 4 + 1));
+        }
+    }
+    return 0;
+}